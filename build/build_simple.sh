@@ -1,7 +1,9 @@
 #!/usr/bin/env bash
 
 echo "Building"
-g++ -std=c++17 ../src/*.cc ../src/util/*.cc -I../src -I../src/util -o dactyl
+# render.cc has a main of its own for dactyl_render, which only the CMake build makes.
+g++ -std=c++17 -O2 ../src/dactyl.cc ../src/key_data.cc ../src/model.cc ../src/sweep.cc \
+  ../src/util/*.cc -I../src -I../src/util -pthread -o dactyl
 if [ $? -ne 0 ]; then
   echo "Failed to build"
   exit 1
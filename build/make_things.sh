@@ -1,9 +1,11 @@
 #!/usr/bin/env bash
+#
+# Renders the printable stl files into ../things. dactyl_render runs OpenSCAD on the left hand
+# parts at the same time and mirrors their meshes into the right hand parts. With --native it
+# evaluates the meshes in process instead, which takes seconds, but they are not yet known to match
+# OpenSCAD's.
 
-echo Making stl, this will take a while.
-
+echo Making stl, without --native this will take a while.
 set -x
-openscad -o ../things/left.stl left.scad
-openscad -o ../things/bottom_left.stl bottom_left.scad
-openscad -o ../things/right.stl right.scad
-openscad -o ../things/bottom_right.stl bottom_right.scad
+# Only parts whose shape changed are rendered, the others come from dactyl_cache.
+./dactyl_render --output ../things "$@"
@@ -0,0 +1,280 @@
+// Microbenchmarks for the hot paths of the generator. Every benchmark runs a fixed workload built
+// from fixed seeds and the default layout, so numbers from different builds can be compared.
+//
+//   ./bench [--json] [--filter <substring>] [--min_time <seconds>]
+//
+// Each benchmark is timed over enough iterations to run for at least min_time, five times, and the
+// median is reported. With --json the results are printed as a JSON array instead of a table.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <glm/glm.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "key.h"
+#include "key_data.h"
+#include "model.h"
+#include "scad.h"
+#include "scad_writer.h"
+#include "stats.h"
+#include "transform.h"
+
+using namespace scad;
+
+namespace {
+
+const int kRepetitions = 5;
+
+// Keeps the compiler from dropping a computation whose result is unused.
+template <typename T>
+void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r"(&value) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &value;
+#endif
+}
+
+struct Benchmark {
+  std::string name;
+  // Runs the workload iterations times and returns the number of bytes it produced, or 0 if
+  // throughput does not apply.
+  std::function<size_t(size_t iterations)> run;
+};
+
+struct BenchmarkResult {
+  std::string name;
+  size_t iterations = 0;
+  double ns_per_op = 0;
+  double min_ns_per_op = 0;
+  // Zero if the benchmark does not produce bytes.
+  double mb_per_second = 0;
+};
+
+BenchmarkResult RunBenchmark(const Benchmark& benchmark, double min_time) {
+  auto time = [&](size_t iterations, size_t* bytes) {
+    auto start = std::chrono::steady_clock::now();
+    *bytes = benchmark.run(iterations);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+  };
+
+  size_t bytes = 0;
+  // The first run warms up the caches and the intern table.
+  size_t iterations = 1;
+  double seconds = time(iterations, &bytes);
+  while (seconds < min_time) {
+    size_t scale = seconds > 0 ? static_cast<size_t>(min_time / seconds * 1.2) : 10;
+    iterations *= std::clamp<size_t>(scale, 2, 10);
+    seconds = time(iterations, &bytes);
+  }
+
+  std::vector<double> samples;
+  double total_bytes = 0;
+  for (int i = 0; i < kRepetitions; ++i) {
+    samples.push_back(time(iterations, &bytes));
+    total_bytes += bytes;
+  }
+  std::sort(samples.begin(), samples.end());
+
+  BenchmarkResult result;
+  result.name = benchmark.name;
+  result.iterations = iterations;
+  result.ns_per_op = samples[kRepetitions / 2] * 1e9 / iterations;
+  result.min_ns_per_op = samples[0] * 1e9 / iterations;
+  if (total_bytes > 0) {
+    result.mb_per_second = total_bytes / kRepetitions / samples[kRepetitions / 2] / 1e6;
+  }
+  return result;
+}
+
+std::vector<glm::vec3> RandomPoints(size_t count) {
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> coordinate(-100, 100);
+  std::vector<glm::vec3> points(count);
+  for (glm::vec3& p : points) {
+    p = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+  }
+  return points;
+}
+
+std::string FormatDouble(const char* format, double value) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), format, value);
+  return buffer;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bool json = false;
+  std::string filter;
+  double min_time = 0.1;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--json") {
+      json = true;
+    } else if (arg == "--filter" && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (arg == "--min_time" && i + 1 < argc) {
+      min_time = std::atof(argv[++i]);
+    } else {
+      fprintf(stderr, "Unknown argument %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  KeyData d;
+  if (!d.Load(DefaultLayoutFile(), GetKeyOrigin())) {
+    return 1;
+  }
+  Key& key = *d.key_d;
+  const TransformList key_transforms = key.GetSwitchTransforms();
+  Transform transform;
+  transform.SetRotation(10, -20, 30);
+  transform.x = 1;
+  transform.y = 2;
+  transform.z = 3;
+
+  const std::vector<glm::vec3> points = RandomPoints(1024);
+  std::vector<glm::vec3> transformed(points.size());
+  const Shape post = GetPostConnector();
+  std::vector<TransformList> corners;
+  for (Key* k : d.grid.row(2)) {
+    if (k) {
+      corners.push_back(k->GetTopLeft());
+      corners.push_back(k->GetBottomLeft());
+    }
+  }
+  const Shape model = BuildModel(d, ModelParams()).left;
+
+  // One iteration is a single call, so ApplyAll transforms all 1024 points per iteration.
+  const std::vector<Benchmark> benchmarks = {
+      {"Transform::Apply/point",
+       [&](size_t n) {
+         for (size_t i = 0; i < n; ++i) {
+           DoNotOptimize(transform.Apply(points[i % points.size()]));
+         }
+         return size_t(0);
+       }},
+      {"TransformList::Apply/point",
+       [&](size_t n) {
+         for (size_t i = 0; i < n; ++i) {
+           DoNotOptimize(key_transforms.Apply(points[i % points.size()]));
+         }
+         return size_t(0);
+       }},
+      {"TransformList::ApplyAll/1024_points",
+       [&](size_t n) {
+         for (size_t i = 0; i < n; ++i) {
+           key_transforms.ApplyAll(points.data(), transformed.data(), points.size());
+           DoNotOptimize(transformed[0]);
+         }
+         return size_t(0);
+       }},
+      {"TransformList::Apply/shape",
+       [&](size_t n) {
+         for (size_t i = 0; i < n; ++i) {
+           DoNotOptimize(key_transforms.Apply(post));
+         }
+         return size_t(0);
+       }},
+      {"Key::GetTopLeft",
+       [&](size_t n) {
+         for (size_t i = 0; i < n; ++i) {
+           DoNotOptimize(key.GetTopLeft());
+         }
+         return size_t(0);
+       }},
+      {"Key::GetTopLeft/offset",
+       [&](size_t n) {
+         for (size_t i = 0; i < n; ++i) {
+           DoNotOptimize(key.GetTopLeft(-1));
+         }
+         return size_t(0);
+       }},
+      {"Key::GetSwitch",
+       [&](size_t n) {
+         for (size_t i = 0; i < n; ++i) {
+           DoNotOptimize(key.GetSwitch());
+         }
+         return size_t(0);
+       }},
+      {"ConnectMainKeys",
+       [&](size_t n) {
+         for (size_t i = 0; i < n; ++i) {
+           DoNotOptimize(ConnectMainKeys(d));
+         }
+         return size_t(0);
+       }},
+      {"TriFan",
+       [&](size_t n) {
+         for (size_t i = 0; i < n; ++i) {
+           DoNotOptimize(TriFan(key_transforms, corners, post));
+         }
+         return size_t(0);
+       }},
+      {"TriMesh",
+       [&](size_t n) {
+         for (size_t i = 0; i < n; ++i) {
+           DoNotOptimize(TriMesh(corners, post));
+         }
+         return size_t(0);
+       }},
+      {"ToScad/left",
+       [&](size_t n) {
+         size_t bytes = 0;
+         for (size_t i = 0; i < n; ++i) {
+           std::string scad = ToScad(model);
+           bytes += scad.size();
+           DoNotOptimize(scad.data());
+         }
+         return bytes;
+       }},
+  };
+
+  std::vector<BenchmarkResult> results;
+  for (const Benchmark& benchmark : benchmarks) {
+    if (benchmark.name.find(filter) != std::string::npos) {
+      results.push_back(RunBenchmark(benchmark, min_time));
+    }
+  }
+
+  if (json) {
+    printf("[");
+    for (size_t i = 0; i < results.size(); ++i) {
+      const BenchmarkResult& r = results[i];
+      printf("%s\n  {\"name\": \"%s\", \"iterations\": %zu, \"ns_per_op\": %.2f, "
+             "\"min_ns_per_op\": %.2f",
+             i == 0 ? "" : ",",
+             r.name.c_str(),
+             r.iterations,
+             r.ns_per_op,
+             r.min_ns_per_op);
+      if (r.mb_per_second > 0) {
+        printf(", \"mb_per_second\": %.2f", r.mb_per_second);
+      }
+      printf("}");
+    }
+    printf("\n]\n");
+    return 0;
+  }
+
+  std::vector<std::vector<std::string>> rows = {
+      {"benchmark", "iterations", "ns/op", "min ns/op", "MB/s"}};
+  for (const BenchmarkResult& r : results) {
+    rows.push_back({r.name,
+                    std::to_string(r.iterations),
+                    FormatDouble("%.1f", r.ns_per_op),
+                    FormatDouble("%.1f", r.min_ns_per_op),
+                    r.mb_per_second > 0 ? FormatDouble("%.1f", r.mb_per_second) : "-"});
+  }
+  printf("%s", FormatTable(rows).c_str());
+  return 0;
+}
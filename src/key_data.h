@@ -1,66 +1,70 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "key.h"
+#include "layout.h"
 #include "transform.h"
 
 namespace scad {
 
-// Key positioning data and description of layout and grouping of keys.
+// The layout file the model is built from unless another one is given.
+std::string DefaultLayoutFile();
+
+// Key positioning data and description of layout and grouping of keys. The keys are placed by a
+// layout file (see layout.h) and the members point at the ones the case is built around.
 struct KeyData {
-  KeyData(TransformList origin);
-
-  Key key_plus;
-  Key key_1;
-  Key key_2;
-  Key key_3;
-  Key key_4;
-  Key key_5;
-
-  Key key_tab;
-  Key key_q;
-  Key key_w;
-  Key key_e;
-  Key key_r;
-  Key key_t;
-
-  Key key_caps;
-  Key key_a;
-  Key key_s;
-  Key key_d;
-  Key key_f;
-  Key key_g;
-
-  Key key_shift;
-  Key key_z;
-  Key key_x;
-  Key key_c;
-  Key key_v;
-  Key key_b;
-
-  Key key_tilde;
-  Key key_slash;
-  Key key_left_arrow;
-  Key key_right_arrow;
-
-  Key key_backspace;
-  Key key_delete;
-  Key key_end;
-  Key key_home;
-  Key key_ctrl;
-  Key key_alt;
-
-  // clang-format off
-  KeyGrid grid {{
-    { &key_plus,   &key_1,      &key_2,      &key_3,           &key_4,            &key_5},
-    { &key_tab,    &key_q,      &key_w,      &key_e,           &key_r,            &key_t},
-    { &key_caps,   &key_a,      &key_s,      &key_d,           &key_f,            &key_g},
-    { &key_shift,  &key_z,      &key_x,      &key_c,           &key_v,            &key_b},
-    { nullptr,     &key_tilde,  &key_slash,  &key_left_arrow,  &key_right_arrow,  nullptr},
-  }};
-  // clang-format on
+  // Loads the layout. Returns false and prints the reason if it can not be loaded or is missing
+  // one of the keys below.
+  bool Load(const std::string& layout_file,
+            const TransformList& origin,
+            const LayoutOverrides& overrides = {});
+
+  Key* key_plus = nullptr;
+  Key* key_1 = nullptr;
+  Key* key_2 = nullptr;
+  Key* key_3 = nullptr;
+  Key* key_4 = nullptr;
+  Key* key_5 = nullptr;
+
+  Key* key_tab = nullptr;
+  Key* key_q = nullptr;
+  Key* key_w = nullptr;
+  Key* key_e = nullptr;
+  Key* key_r = nullptr;
+  Key* key_t = nullptr;
+
+  Key* key_caps = nullptr;
+  Key* key_a = nullptr;
+  Key* key_s = nullptr;
+  Key* key_d = nullptr;
+  Key* key_f = nullptr;
+  Key* key_g = nullptr;
+
+  Key* key_shift = nullptr;
+  Key* key_z = nullptr;
+  Key* key_x = nullptr;
+  Key* key_c = nullptr;
+  Key* key_v = nullptr;
+  Key* key_b = nullptr;
+
+  Key* key_tilde = nullptr;
+  Key* key_slash = nullptr;
+  Key* key_left_arrow = nullptr;
+  Key* key_right_arrow = nullptr;
+
+  Key* key_backspace = nullptr;
+  Key* key_delete = nullptr;
+  Key* key_end = nullptr;
+  Key* key_home = nullptr;
+  Key* key_ctrl = nullptr;
+  Key* key_alt = nullptr;
+
+  KeyGrid grid{{}};
 
   std::vector<Key*> thumb_keys() {
-    return {&key_delete, &key_backspace, &key_ctrl, &key_alt, &key_home, &key_end};
+    return layout.thumb_keys;
   }
 
   std::vector<Key*> all_keys() {
@@ -73,6 +77,8 @@ struct KeyData {
     }
     return keys;
   }
+
+  Layout layout;
 };
 
 }  // namespace scad
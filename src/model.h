@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "key_data.h"
+#include "output.h"
+#include "scad.h"
+#include "transform.h"
+
+namespace scad {
+
+// Everything about the case which is not part of the layout.
+struct ModelParams {
+  // How far the walls are pushed out past the key corners, and how thick they are at the bottom.
+  double wall_distance = 4.8;
+  double wall_width = 3.3;
+  // Add the caps into the output for testing.
+  bool add_caps = false;
+  // Cheap stand-ins for a quick look at the shape: fewer segments on curved primitives, boxes for
+  // the switch nubs, walls made of the slices without hulling neighbors together and no cutouts.
+  bool preview = false;
+};
+
+// Curved primitives are limited to this many segments in a preview.
+const int kPreviewFragments = 8;
+
+// A part of the case which can be rendered on its own.
+struct SubAssembly {
+  std::string name;
+  Shape shape;
+};
+
+// The left hand parts. The right hand ones are their mirror images.
+struct Model {
+  Shape left;
+  Shape bottom_plate;
+
+  // The case before the cutouts are subtracted, split into parts whose union is the whole case.
+  std::vector<SubAssembly> assemblies;
+  // What left and bottom_plate are built from besides the case. The cutouts and screw holes are
+  // empty in a preview.
+  Shape cutouts;
+  Shape screw_holes;
+  std::vector<Shape> switch_hulls;
+};
+
+// Where the layout is placed.
+TransformList GetKeyOrigin();
+
+// Connects every key in the grid to its neighbors on the left, above and diagonally up left.
+Shape ConnectMainKeys(KeyData& d);
+
+// Builds the case around the keys. This is only cosmetic, all of the logic to position the keys is
+// in the layout.
+Model BuildModel(KeyData& d, const ModelParams& params);
+
+// Replaces the sub-assemblies in left and bottom_plate with imports of their rendered meshes, so
+// OpenSCAD only has to union the meshes and only the sub-assemblies which changed are rendered
+// again. Returns the jobs which render them into an assemblies directory under directory.
+std::vector<OutputJob> UseRenderedAssemblies(const std::string& directory, Model* model);
+
+// The jobs which write both hands of the model in format. directory is prepended to the file names
+// as is, so it needs a trailing separator.
+std::vector<OutputJob> GetOutputJobs(const Model& model,
+                                     const std::string& directory,
+                                     OutputFormat format);
+
+}  // namespace scad
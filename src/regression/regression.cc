@@ -0,0 +1,489 @@
+// Generates the whole model in process several times and checks it against a golden file: the scad
+// files have to be byte for byte the same and the meshes the same within a small tolerance. The
+// volumes of the meshes are also compared with the STL files in things/, and every hull of the
+// model which spans a volume has to be evaluated in process.
+//
+//   ./regression [--golden <file>] [--update] [--runs <n>] [--check_perf]
+//                [--time_tolerance <fraction>] [--rss_tolerance <fraction>]
+//
+// The time and memory of the golden file were measured on one machine, so they are only compared
+// with --check_perf, on that machine with a build of the same type. Otherwise they are printed.
+//
+// --update rewrites the golden file from the current outputs and timings, after a change which is
+// meant to change the output or on a new machine. It refuses to while any of the other checks
+// fail. The meshes in the golden file are compared with things/ as well.
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "evaluate.h"
+#include "hull.h"
+#include "key_data.h"
+#include "mesh.h"
+#include "model.h"
+#include "optimize.h"
+#include "output.h"
+#include "parallel.h"
+#include "scad_writer.h"
+#include "stl.h"
+
+using namespace scad;
+
+// Builds with CMake point these at the source tree.
+#ifndef DACTYL_REGRESSION_GOLDEN
+#define DACTYL_REGRESSION_GOLDEN "../src/regression/golden.txt"
+#endif
+#ifndef DACTYL_THINGS_DIRECTORY
+#define DACTYL_THINGS_DIRECTORY "../things"
+#endif
+
+namespace {
+
+// Meshes are compared by their volume and bounds, so a change in how the evaluator splits faces
+// into triangles is not a regression.
+const double kVolumeTolerance = 1e-6;  // Relative.
+const double kBoundsTolerance = 1e-4;  // mm.
+// The STL files in things/ were rendered by OpenSCAD from an older revision of the model, so
+// volumes only agree with them roughly. That is still close enough to notice a missing part, like
+// a hull the evaluator dropped.
+const double kReferenceVolumeTolerance = 5e-4;  // Relative.
+
+struct Output {
+  std::string name;
+  bool is_mesh = false;
+  long long bytes = 0;
+  // For scad files.
+  uint64_t hash = 0;
+  // For meshes.
+  double volume = 0;
+  glm::dvec3 min = glm::dvec3(0);
+  glm::dvec3 max = glm::dvec3(0);
+};
+
+struct Golden {
+  double seconds = 0;
+  double peak_rss_mb = 0;
+  std::map<std::string, Output> outputs;
+};
+
+// FNV-1a.
+uint64_t HashBytes(const std::string& data) {
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+double GetVolume(const Mesh& mesh) {
+  double volume = 0;
+  for (const auto& t : mesh.triangles) {
+    volume += glm::dot(mesh.vertices[t[0]],
+                       glm::cross(mesh.vertices[t[1]], mesh.vertices[t[2]]));
+  }
+  return volume / 6;
+}
+
+double GetPeakRssMb() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+  return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+bool Generate(std::vector<Output>* outputs) {
+  KeyData d;
+  if (!d.Load(DefaultLayoutFile(), GetKeyOrigin())) {
+    return false;
+  }
+  Model model = BuildModel(d, ModelParams());
+  std::vector<OutputJob> jobs = GetOutputJobs(model, "", OutputFormat::SCAD);
+  std::vector<OutputJob> mesh_jobs = GetOutputJobs(model, "", OutputFormat::STL);
+  jobs.insert(jobs.end(), mesh_jobs.begin(), mesh_jobs.end());
+
+  // The same work WriteOutputs does, without the files.
+  std::vector<Output> results(jobs.size());
+  std::vector<char> ok(jobs.size(), false);
+  ParallelFor(jobs.size(), [&](size_t i) {
+    const OutputJob& job = jobs[i];
+    Output& output = results[i];
+    output.name = job.path;
+    if (job.format == OutputFormat::SCAD) {
+      std::string scad = ToScad(Optimize(job.shape));
+      output.bytes = scad.size();
+      output.hash = HashBytes(scad);
+      ok[i] = true;
+      return;
+    }
+    Mesh mesh;
+    if (!EvaluateMesh(OptimizeForMesh(job.shape), &mesh) || mesh.vertices.empty()) {
+      return;
+    }
+    output.is_mesh = true;
+    // The size of the binary STL file.
+    output.bytes = 84 + 50 * static_cast<long long>(mesh.triangles.size());
+    output.volume = GetVolume(mesh);
+    output.min = output.max = mesh.vertices[0];
+    for (const glm::dvec3& v : mesh.vertices) {
+      output.min = glm::min(output.min, v);
+      output.max = glm::max(output.max, v);
+    }
+    ok[i] = true;
+  });
+  *outputs = results;
+  return std::all_of(ok.begin(), ok.end(), [](char c) { return c; });
+}
+
+// Whether points span a volume, tested without the hull code so the check below does not depend on
+// what it checks.
+bool SpansVolume(const std::vector<glm::dvec3>& points) {
+  if (points.size() < 4) {
+    return false;
+  }
+  glm::dvec3 p0 = points[0];
+  glm::dvec3 p1 = p0;
+  for (const glm::dvec3& p : points) {
+    p1 = glm::length(p - p0) > glm::length(p1 - p0) ? p : p1;
+  }
+  double size = glm::length(p1 - p0);
+  glm::dvec3 dir = glm::normalize(p1 - p0);
+  glm::dvec3 p2 = p0;
+  for (const glm::dvec3& p : points) {
+    p2 = glm::length(glm::cross(p - p0, dir)) > glm::length(glm::cross(p2 - p0, dir)) ? p : p2;
+  }
+  if (!(glm::length(glm::cross(p2 - p0, dir)) > 1e-6 * size)) {
+    return false;
+  }
+  glm::dvec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+  for (const glm::dvec3& p : points) {
+    if (std::abs(glm::dot(p - p0, normal)) > 1e-6 * size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Every hull in the model which can be described by its points and spans a volume has to be
+// evaluated in process. One which is not is left for OpenSCAD in the scad files, and is missing
+// from the meshes.
+bool CheckHulls() {
+  KeyData d;
+  if (!d.Load(DefaultLayoutFile(), GetKeyOrigin())) {
+    return false;
+  }
+  Model model = BuildModel(d, ModelParams());
+  int hulls = 0;
+  bool ok = true;
+  VisitNodes(Union(model.left, model.bottom_plate), [&](const Node& node) {
+    if (node.type != NodeType::HULL) {
+      return;
+    }
+    std::vector<glm::dvec3> points;
+    for (const Shape& child : node.children) {
+      if (!CollectHullPoints(child, &points)) {
+        return;
+      }
+    }
+    ++hulls;
+    if (SpansVolume(points) && EvaluateHull(node.children).empty()) {
+      glm::dvec3 min = points[0];
+      glm::dvec3 max = points[0];
+      for (const glm::dvec3& p : points) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+      }
+      printf("FAIL hull of %zu points from %.3f %.3f %.3f to %.3f %.3f %.3f was not evaluated\n",
+             points.size(),
+             min.x,
+             min.y,
+             min.z,
+             max.x,
+             max.y,
+             max.z);
+      ok = false;
+    }
+  });
+  printf("checked %d hulls\n", hulls);
+  return ok;
+}
+
+// Compares the volume of every mesh in outputs with the file of the same name in things/. source
+// says where outputs come from in the messages.
+bool CheckReferenceVolumes(const std::vector<Output>& outputs, const std::string& source) {
+  bool ok = true;
+  for (const Output& output : outputs) {
+    if (!output.is_mesh) {
+      continue;
+    }
+    std::string file_name = std::string(DACTYL_THINGS_DIRECTORY) + "/" + output.name;
+    Mesh reference;
+    if (!ReadStlFile(file_name, &reference)) {
+      printf("FAIL could not read %s\n", file_name.c_str());
+      ok = false;
+      continue;
+    }
+    double volume = GetVolume(reference);
+    if (std::abs(output.volume - volume) > kReferenceVolumeTolerance * std::abs(volume)) {
+      printf("FAIL %s in %s has a volume of %.3f, %s has %.3f\n",
+             output.name.c_str(),
+             source.c_str(),
+             output.volume,
+             file_name.c_str(),
+             volume);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool SameOutput(const Output& a, const Output& b) {
+  if (a.is_mesh != b.is_mesh) {
+    return false;
+  }
+  if (!a.is_mesh) {
+    return a.hash == b.hash && a.bytes == b.bytes;
+  }
+  double scale = std::max(1.0, std::abs(b.volume));
+  if (std::abs(a.volume - b.volume) > kVolumeTolerance * scale) {
+    return false;
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (std::abs(a.min[i] - b.min[i]) > kBoundsTolerance ||
+        std::abs(a.max[i] - b.max[i]) > kBoundsTolerance) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string FormatOutput(const Output& output) {
+  char buffer[256];
+  if (output.is_mesh) {
+    snprintf(buffer,
+             sizeof(buffer),
+             "mesh %s %lld %.6f %.6f %.6f %.6f %.6f %.6f %.6f",
+             output.name.c_str(),
+             output.bytes,
+             output.volume,
+             output.min.x,
+             output.min.y,
+             output.min.z,
+             output.max.x,
+             output.max.y,
+             output.max.z);
+  } else {
+    snprintf(buffer,
+             sizeof(buffer),
+             "scad %s %lld %016llx",
+             output.name.c_str(),
+             output.bytes,
+             static_cast<unsigned long long>(output.hash));
+  }
+  return buffer;
+}
+
+// One entry per line:
+//   seconds <median wall time of a run>
+//   peak_rss_mb <mb>
+//   scad <file> <bytes> <hash>
+//   mesh <file> <bytes> <volume> <min x y z> <max x y z>
+bool ReadGolden(const std::string& file_name, Golden* golden) {
+  std::ifstream in(file_name);
+  if (!in) {
+    fprintf(stderr, "Could not read %s, run with --update to create it\n", file_name.c_str());
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string kind;
+    if (!(fields >> kind) || kind[0] == '#') {
+      continue;
+    }
+    bool ok = true;
+    if (kind == "seconds") {
+      ok = static_cast<bool>(fields >> golden->seconds);
+    } else if (kind == "peak_rss_mb") {
+      ok = static_cast<bool>(fields >> golden->peak_rss_mb);
+    } else if (kind == "scad") {
+      Output output;
+      std::string hash;
+      ok = static_cast<bool>(fields >> output.name >> output.bytes >> hash);
+      output.hash = std::strtoull(hash.c_str(), nullptr, 16);
+      golden->outputs[output.name] = output;
+    } else if (kind == "mesh") {
+      Output output;
+      output.is_mesh = true;
+      ok = static_cast<bool>(fields >> output.name >> output.bytes >> output.volume >>
+                             output.min.x >> output.min.y >> output.min.z >> output.max.x >>
+                             output.max.y >> output.max.z);
+      golden->outputs[output.name] = output;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      fprintf(stderr, "Bad line in %s: %s\n", file_name.c_str(), line.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool WriteGolden(const std::string& file_name,
+                 double seconds,
+                 double peak_rss_mb,
+                 const std::vector<Output>& outputs) {
+  std::ofstream out(file_name);
+  out << "# Written by regression --update.\n";
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "seconds %.3f\npeak_rss_mb %.1f\n", seconds, peak_rss_mb);
+  out << buffer;
+  for (const Output& output : outputs) {
+    out << FormatOutput(output) << "\n";
+  }
+  out.close();
+  if (!out) {
+    fprintf(stderr, "Could not write file %s\n", file_name.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string golden_file = DACTYL_REGRESSION_GOLDEN;
+  bool update = false;
+  bool check_perf = false;
+  int runs = 3;
+  // How much slower or bigger than the golden file a run may be, as a fraction. Generous, since
+  // timings vary between machines and with load.
+  double time_tolerance = 1.0;
+  double rss_tolerance = 0.5;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--golden" && i + 1 < argc) {
+      golden_file = argv[++i];
+    } else if (arg == "--update") {
+      update = true;
+    } else if (arg == "--check_perf") {
+      check_perf = true;
+    } else if (arg == "--runs" && i + 1 < argc) {
+      runs = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--time_tolerance" && i + 1 < argc) {
+      time_tolerance = std::atof(argv[++i]);
+    } else if (arg == "--rss_tolerance" && i + 1 < argc) {
+      rss_tolerance = std::atof(argv[++i]);
+    } else {
+      fprintf(stderr, "Unknown argument %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::vector<Output> outputs;
+  std::vector<double> seconds;
+  bool ok = CheckHulls();
+  for (int run = 0; run < runs; ++run) {
+    std::vector<Output> run_outputs;
+    auto start = std::chrono::steady_clock::now();
+    if (!Generate(&run_outputs)) {
+      fprintf(stderr, "Generating the model failed\n");
+      return 1;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    seconds.push_back(elapsed.count());
+    printf("run %d: %.3fs\n", run + 1, elapsed.count());
+    if (run == 0) {
+      outputs = run_outputs;
+      continue;
+    }
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      if (!SameOutput(run_outputs[i], outputs[i])) {
+        printf("FAIL %s differs between runs\n", outputs[i].name.c_str());
+        ok = false;
+      }
+    }
+  }
+  std::sort(seconds.begin(), seconds.end());
+  double median_seconds = seconds[seconds.size() / 2];
+  double peak_rss_mb = GetPeakRssMb();
+  printf("median %.3fs, peak rss %.1fmb\n", median_seconds, peak_rss_mb);
+  for (const Output& output : outputs) {
+    printf("%s\n", FormatOutput(output).c_str());
+  }
+  if (!CheckReferenceVolumes(outputs, "this run")) {
+    ok = false;
+  }
+
+  if (update) {
+    if (!ok || !WriteGolden(golden_file, median_seconds, peak_rss_mb, outputs)) {
+      return 1;
+    }
+    printf("updated %s\n", golden_file.c_str());
+    return 0;
+  }
+
+  Golden golden;
+  if (!ReadGolden(golden_file, &golden)) {
+    return 1;
+  }
+  // Otherwise a golden file written while a part was missing would make that the expected output.
+  std::vector<Output> golden_outputs;
+  for (const auto& entry : golden.outputs) {
+    golden_outputs.push_back(entry.second);
+  }
+  if (!CheckReferenceVolumes(golden_outputs, golden_file)) {
+    ok = false;
+  }
+  for (const Output& output : outputs) {
+    auto it = golden.outputs.find(output.name);
+    if (it == golden.outputs.end()) {
+      printf("FAIL %s is not in the golden file\n", output.name.c_str());
+      ok = false;
+    } else if (!SameOutput(output, it->second)) {
+      printf("FAIL %s changed, golden: %s\n",
+             output.name.c_str(),
+             FormatOutput(it->second).c_str());
+      ok = false;
+    }
+    golden.outputs.erase(output.name);
+  }
+  for (const auto& missing : golden.outputs) {
+    printf("FAIL %s was not generated\n", missing.first.c_str());
+    ok = false;
+  }
+  // Without --check_perf these are printed, but do not fail the run.
+  const char* perf_failure = check_perf ? "FAIL" : "note:";
+  if (median_seconds > golden.seconds * (1 + time_tolerance)) {
+    printf("%s %.3fs is slower than the golden %.3fs\n",
+           perf_failure,
+           median_seconds,
+           golden.seconds);
+    ok = ok && !check_perf;
+  }
+  if (peak_rss_mb > golden.peak_rss_mb * (1 + rss_tolerance)) {
+    printf("%s peak rss %.1fmb is over the golden %.1fmb\n",
+           perf_failure,
+           peak_rss_mb,
+           golden.peak_rss_mb);
+    ok = ok && !check_perf;
+  }
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
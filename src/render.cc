@@ -0,0 +1,169 @@
+// Renders the printable STL files of the model into a directory. The left hand parts are rendered
+// once, with OpenSCAD or with --native in process, and the right hand parts are made by mirroring
+// their meshes. The steps run on a pool of worker threads which picks up each step as soon as the
+// steps it needs are done, so the OpenSCAD renders of the parts run at the same time.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <glm/glm.hpp>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "key_data.h"
+#include "mesh.h"
+#include "model.h"
+#include "output.h"
+#include "stl.h"
+#include "task_graph.h"
+
+using namespace scad;
+
+// Shared with dactyl, so parts it already rendered are not rendered again.
+constexpr char kCacheDirectory[] = "dactyl_cache";
+
+namespace {
+
+// A left hand part and its mirror image.
+struct Part {
+  std::string left_name;
+  std::string right_name;
+  Shape Model::*shape;
+};
+
+bool MirrorStl(const std::string& input_file, const std::string& output_file) {
+  Mesh mesh;
+  if (!ReadStlFile(input_file, &mesh)) {
+    fprintf(stderr, "Could not read %s\n", input_file.c_str());
+    return false;
+  }
+  if (WriteStlFile(MirrorMesh(mesh, glm::dvec3(1, 0, 0)), output_file) < 0) {
+    fprintf(stderr, "Could not write file %s\n", output_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string layout_file = DefaultLayoutFile();
+  std::string output_directory = ".";
+  int num_threads = 0;
+  bool use_cache = true;
+  // OpenSCAD renders the reference meshes, --native evaluates them in process in seconds instead.
+  OutputFormat format = OutputFormat::OPENSCAD_STL;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--layout" && i + 1 < argc) {
+      layout_file = argv[++i];
+    } else if (arg == "--output" && i + 1 < argc) {
+      output_directory = argv[++i];
+    } else if (arg == "--threads" && i + 1 < argc) {
+      num_threads = std::atoi(argv[++i]);
+    } else if (arg == "--no_cache") {
+      use_cache = false;
+    } else if (arg == "--native") {
+      format = OutputFormat::STL;
+    } else {
+      fprintf(stderr, "Unknown argument %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(output_directory, error);
+  if (error) {
+    fprintf(stderr, "Could not create directory %s\n", output_directory.c_str());
+    return 1;
+  }
+  std::unique_ptr<OutputCache> cache;
+  if (use_cache) {
+    cache = std::make_unique<OutputCache>(kCacheDirectory);
+    if (!cache->ok()) {
+      return 1;
+    }
+  }
+
+  const std::vector<Part> parts = {
+      {"left.stl", "right.stl", &Model::left},
+      {"bottom_left.stl", "bottom_right.stl", &Model::bottom_plate},
+  };
+  // What each step did, filled in by the step itself and printed once it is done.
+  std::map<std::string, std::string> notes = {{"model", ""}};
+  Model model;
+
+  TaskGraph graph;
+  TaskGraph::TaskId build = graph.Add("model", [&]() {
+    KeyData d;
+    if (!d.Load(layout_file, GetKeyOrigin())) {
+      return false;
+    }
+    model = BuildModel(d, ModelParams());
+    notes["model"] = "built";
+    return true;
+  });
+  for (const Part& part : parts) {
+    std::string left_file = output_directory + "/" + part.left_name;
+    std::string right_file = output_directory + "/" + part.right_name;
+    notes[part.left_name];
+    notes[part.right_name];
+    TaskGraph::TaskId render = graph.Add(
+        part.left_name,
+        [&, left_file]() {
+          OutputJob job = {model.*part.shape, left_file, format};
+          OutputResult result = cache ? cache->Write(job) : WriteOutput(job);
+          if (result.source == OutputSource::UP_TO_DATE) {
+            notes[part.left_name] = "unchanged";
+          } else if (result.source == OutputSource::CACHED) {
+            notes[part.left_name] = "copied from the cache";
+          } else {
+            notes[part.left_name] =
+                format == OutputFormat::OPENSCAD_STL ? "rendered with OpenSCAD" : "rendered";
+          }
+          return result.ok;
+        },
+        {build});
+    graph.Add(
+        part.right_name,
+        [&, left_file, right_file]() {
+          notes[part.right_name] = "mirrored";
+          return MirrorStl(left_file, right_file);
+        },
+        {render});
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  double work_seconds = 0;
+  std::vector<TaskResult> results =
+      graph.Run(num_threads, [&](const TaskResult& result, size_t finished, size_t total) {
+        work_seconds += result.seconds;
+        if (!result.ran) {
+          printf("[%zu/%zu] %s skipped\n", finished, total, result.name.c_str());
+        } else if (!result.ok) {
+          printf("[%zu/%zu] %s failed\n", finished, total, result.name.c_str());
+        } else {
+          printf("[%zu/%zu] %s %s in %.2fs\n",
+                 finished,
+                 total,
+                 result.name.c_str(),
+                 notes[result.name].c_str(),
+                 result.seconds);
+        }
+        fflush(stdout);
+      });
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  if (cache) {
+    cache->Save();
+  }
+
+  bool ok = true;
+  for (const TaskResult& result : results) {
+    ok = ok && result.ok;
+  }
+  printf("%s in %.2fs, %.2fs of work\n", ok ? "done" : "failed", elapsed.count(), work_seconds);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+#include "sweep.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "key_data.h"
+#include "layout.h"
+#include "model.h"
+#include "output.h"
+#include "parallel.h"
+#include "stats.h"
+
+namespace scad {
+namespace {
+
+struct Variant {
+  std::string name;
+  std::string directory;
+  ModelParams params;
+  LayoutOverrides overrides;
+  std::vector<OutputJob> jobs;
+  bool built = false;
+};
+
+bool ParseDouble(const std::string& s, double* value) {
+  char* end = nullptr;
+  *value = std::strtod(s.c_str(), &end);
+  return !s.empty() && end == s.c_str() + s.size();
+}
+
+std::vector<std::string> Split(const std::string& s, char separator) {
+  std::vector<std::string> parts;
+  size_t start = 0;
+  while (true) {
+    size_t end = s.find(separator, start);
+    parts.push_back(s.substr(start, end - start));
+    if (end == std::string::npos) {
+      return parts;
+    }
+    start = end + 1;
+  }
+}
+
+std::string FormatNumber(double value) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%g", value);
+  return buffer;
+}
+
+}  // namespace
+
+bool ParseSweepParam(const std::string& spec, SweepParam* param) {
+  size_t equals = spec.find('=');
+  if (equals == std::string::npos || equals == 0) {
+    fprintf(stderr, "Expected name=start:end:step or name=a,b,c instead of %s\n", spec.c_str());
+    return false;
+  }
+  SweepParam result;
+  result.name = spec.substr(0, equals);
+  std::string values = spec.substr(equals + 1);
+
+  std::vector<std::string> range = Split(values, ':');
+  if (range.size() == 3) {
+    double start, end, step;
+    if (!ParseDouble(range[0], &start) || !ParseDouble(range[1], &end) ||
+        !ParseDouble(range[2], &step) || step <= 0 || end < start) {
+      fprintf(stderr, "Bad range %s, expected start:end:step\n", values.c_str());
+      return false;
+    }
+    // Computed from the index so the steps do not accumulate rounding error, with some slack so
+    // the end is included.
+    for (int i = 0; start + i * step <= end + step * 1e-6; ++i) {
+      result.values.push_back(start + i * step);
+    }
+  } else {
+    for (const std::string& value : Split(values, ',')) {
+      double number;
+      if (!ParseDouble(value, &number)) {
+        fprintf(stderr, "Bad value %s for %s\n", value.c_str(), result.name.c_str());
+        return false;
+      }
+      result.values.push_back(number);
+    }
+  }
+  *param = std::move(result);
+  return true;
+}
+
+bool RunSweep(const std::string& layout_file,
+              const ModelParams& base_params,
+              const std::vector<SweepParam>& sweep_params,
+              const std::string& output_directory,
+              const std::string& cache_directory,
+              bool write_stl) {
+  size_t count = 1;
+  for (const SweepParam& param : sweep_params) {
+    count *= param.values.size();
+  }
+
+  // Every combination, with the last parameter changing fastest.
+  std::vector<Variant> variants(count);
+  for (size_t i = 0; i < count; ++i) {
+    Variant& variant = variants[i];
+    char name[32];
+    snprintf(name, sizeof(name), "variant_%03zu", i);
+    variant.name = name;
+    variant.directory = output_directory + "/" + variant.name + "/";
+    variant.params = base_params;
+    size_t rest = i;
+    for (size_t p = sweep_params.size(); p-- > 0;) {
+      const SweepParam& param = sweep_params[p];
+      double value = param.values[rest % param.values.size()];
+      rest /= param.values.size();
+      if (param.name == "wall_distance") {
+        variant.params.wall_distance = value;
+      } else if (param.name == "wall_width") {
+        variant.params.wall_width = value;
+      } else {
+        variant.overrides[param.name] = value;
+      }
+    }
+    std::error_code error;
+    std::filesystem::create_directories(variant.directory, error);
+    if (error) {
+      fprintf(stderr, "Could not create directory %s\n", variant.directory.c_str());
+      return false;
+    }
+  }
+
+  // Catch typos in the parameter names once, rather than once per variant.
+  KeyData check;
+  if (!check.Load(layout_file, GetKeyOrigin(), variants[0].overrides)) {
+    return false;
+  }
+
+  // Building a model takes milliseconds and writing it takes the rest, so the models are built on
+  // the pool first and then every file of every variant is written on it. Keys fill their caches
+  // while they are read (see Key::GetCache), so every worker loads keys of its own.
+  ParallelFor(count, [&](size_t i) {
+    Variant& variant = variants[i];
+    KeyData d;
+    if (!d.Load(layout_file, GetKeyOrigin(), variant.overrides)) {
+      return;
+    }
+    Model model = BuildModel(d, variant.params);
+    variant.jobs = GetOutputJobs(model, variant.directory, OutputFormat::SCAD);
+    if (write_stl) {
+      std::vector<OutputJob> stl_jobs = GetOutputJobs(model, variant.directory, OutputFormat::STL);
+      variant.jobs.insert(variant.jobs.end(), stl_jobs.begin(), stl_jobs.end());
+    }
+    variant.built = true;
+  });
+
+  std::vector<OutputJob> jobs;
+  for (const Variant& variant : variants) {
+    jobs.insert(jobs.end(), variant.jobs.begin(), variant.jobs.end());
+  }
+  std::vector<OutputResult> results =
+      cache_directory.empty() ? WriteOutputs(jobs) : WriteOutputsCached(jobs, cache_directory);
+
+  std::vector<std::vector<std::string>> rows;
+  std::vector<std::string> header = {"variant"};
+  for (const SweepParam& param : sweep_params) {
+    header.push_back(param.name);
+  }
+  header.insert(header.end(), {"files", "kb", "seconds", "status"});
+  rows.push_back(header);
+
+  bool all_ok = true;
+  size_t result_index = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const Variant& variant = variants[i];
+    bool ok = variant.built;
+    long long bytes = 0;
+    double seconds = 0;
+    for (size_t j = 0; j < variant.jobs.size(); ++j) {
+      const OutputResult& result = results[result_index++];
+      ok = ok && result.ok;
+      bytes += std::max(result.bytes, 0LL);
+      seconds += result.seconds;
+    }
+    all_ok = all_ok && ok;
+
+    std::vector<std::string> row = {variant.name};
+    size_t rest = i;
+    std::vector<std::string> values(sweep_params.size());
+    for (size_t p = sweep_params.size(); p-- > 0;) {
+      const SweepParam& param = sweep_params[p];
+      values[p] = FormatNumber(param.values[rest % param.values.size()]);
+      rest /= param.values.size();
+    }
+    row.insert(row.end(), values.begin(), values.end());
+    row.push_back(std::to_string(variant.jobs.size()));
+    row.push_back(std::to_string(bytes / 1024));
+    row.push_back(FormatNumber(seconds));
+    row.push_back(ok ? "ok" : "failed");
+    rows.push_back(row);
+  }
+
+  std::string table = FormatTable(rows);
+  printf("%s", table.c_str());
+  std::string summary_file = output_directory + "/summary.txt";
+  std::ofstream summary(summary_file);
+  summary << table;
+  if (!summary) {
+    fprintf(stderr, "Could not write file %s\n", summary_file.c_str());
+    return false;
+  }
+  return all_ok;
+}
+
+}  // namespace scad
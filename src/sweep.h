@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "model.h"
+
+namespace scad {
+
+// A parameter to sweep and the values to try. wall_distance and wall_width are model parameters
+// (see ModelParams), any other name overrides the layout (see LayoutOverrides).
+struct SweepParam {
+  std::string name;
+  std::vector<double> values;
+};
+
+// Parses name=start:end:step, which includes end, or name=a,b,c. Returns false and prints the
+// reason if it is malformed.
+bool ParseSweepParam(const std::string& spec, SweepParam* param);
+
+// Builds a variant of the model for every combination of the parameter values and writes each into
+// its own directory under output_directory, on a pool of worker threads. Prints a table of the
+// variants, which is also written to summary.txt in output_directory. Unless cache_directory is
+// empty, files go through the output cache there (see WriteOutputsCached). Returns false if any
+// variant failed.
+bool RunSweep(const std::string& layout_file,
+              const ModelParams& base_params,
+              const std::vector<SweepParam>& sweep_params,
+              const std::string& output_directory,
+              const std::string& cache_directory,
+              bool write_stl);
+
+}  // namespace scad
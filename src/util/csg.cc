@@ -0,0 +1,952 @@
+#include "csg.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hull.h"
+#include "mesh.h"
+
+namespace scad {
+namespace {
+
+// Triangles with twice their area below this are dropped.
+const double kMinArea = 1e-12;
+// Vertices closer than this are merged when building the final mesh, and vertices closer than this
+// to an edge are inserted into it. This is larger than kCsgEpsilon since points which were treated
+// as being on a plane can be up to kCsgEpsilon off it, and clipping by nearly parallel planes
+// moves the resulting vertices further than that.
+const double kWeldDistance = 1e-5;
+// Edges shorter than this and triangles thinner than this are removed from the final mesh.
+const double kSliverSize = 1e-4;
+
+enum PointSide { COPLANAR = 0, FRONT = 1, BACK = 2, SPANNING = 3 };
+
+uint64_t EdgeKey(int a, int b) {
+  return (static_cast<uint64_t>(a) << 32) | static_cast<uint32_t>(b);
+}
+
+// Newell's method, which gives a sensible normal for facets with collinear vertices. The length
+// of the result is twice the area of the facet.
+glm::dvec3 AreaNormal(const std::vector<glm::dvec3>& vertices) {
+  glm::dvec3 normal(0);
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    const glm::dvec3& a = vertices[i];
+    const glm::dvec3& b = vertices[(i + 1) % vertices.size()];
+    normal += glm::cross(a, b);
+  }
+  return normal;
+}
+
+Plane MakePlane(const glm::dvec3& normal, const glm::dvec3& point) {
+  return {normal, glm::dot(normal, point)};
+}
+
+void FlipFacet(Facet* facet) {
+  std::reverse(facet->vertices.begin(), facet->vertices.end());
+  facet->plane.normal = -facet->plane.normal;
+  facet->plane.w = -facet->plane.w;
+}
+
+Box FacetBox(const Facet& facet) {
+  Box box;
+  for (const glm::dvec3& v : facet.vertices) {
+    box.Add(v);
+  }
+  return box;
+}
+
+// Sorts facet into the lists for the side of plane it is on, splitting it if it crosses the
+// plane. Facets in the plane go to coplanar_front or coplanar_back depending on which way they
+// face.
+void SplitFacet(const Plane& plane,
+                const Facet& facet,
+                std::vector<Facet>* coplanar_front,
+                std::vector<Facet>* coplanar_back,
+                std::vector<Facet>* front,
+                std::vector<Facet>* back) {
+  const size_t n = facet.vertices.size();
+  int facet_side = COPLANAR;
+  // Most facets have few vertices, only allocate for the rest.
+  std::array<int, 16> small_sides;
+  std::vector<int> large_sides;
+  int* sides = small_sides.data();
+  if (n > small_sides.size()) {
+    large_sides.resize(n);
+    sides = large_sides.data();
+  }
+  for (size_t i = 0; i < n; ++i) {
+    double t = glm::dot(plane.normal, facet.vertices[i]) - plane.w;
+    int side = t < -kCsgEpsilon ? BACK : (t > kCsgEpsilon ? FRONT : COPLANAR);
+    facet_side |= side;
+    sides[i] = side;
+  }
+  switch (facet_side) {
+    case COPLANAR:
+      if (glm::dot(plane.normal, facet.plane.normal) > 0) {
+        coplanar_front->push_back(facet);
+      } else {
+        coplanar_back->push_back(facet);
+      }
+      break;
+    case FRONT:
+      front->push_back(facet);
+      break;
+    case BACK:
+      back->push_back(facet);
+      break;
+    case SPANNING: {
+      Facet f;
+      Facet b;
+      f.plane = facet.plane;
+      b.plane = facet.plane;
+      for (size_t i = 0; i < n; ++i) {
+        size_t j = (i + 1) % n;
+        int si = sides[i];
+        int sj = sides[j];
+        const glm::dvec3& vi = facet.vertices[i];
+        const glm::dvec3& vj = facet.vertices[j];
+        if (si != BACK) {
+          f.vertices.push_back(vi);
+        }
+        if (si != FRONT) {
+          b.vertices.push_back(vi);
+        }
+        if ((si | sj) == SPANNING) {
+          double t = (plane.w - glm::dot(plane.normal, vi)) / glm::dot(plane.normal, vj - vi);
+          glm::dvec3 v = vi + (vj - vi) * t;
+          f.vertices.push_back(v);
+          b.vertices.push_back(v);
+        }
+      }
+      if (f.vertices.size() >= 3) {
+        front->push_back(std::move(f));
+      }
+      if (b.vertices.size() >= 3) {
+        back->push_back(std::move(b));
+      }
+      break;
+    }
+  }
+}
+
+// A BSP tree over the facets of a solid. Each node splits space by the plane of its first
+// facet and keeps every facet in that plane. Space behind a node without a back child is
+// inside the solid and space in front of a node without a front child is outside of it.
+class BspNode {
+ public:
+  explicit BspNode(std::vector<Facet> facets) {
+    Build(std::move(facets));
+  }
+
+  // Turns the solid inside out.
+  void Invert() {
+    for (Facet& facet : polygons_) {
+      FlipFacet(&facet);
+    }
+    plane_.normal = -plane_.normal;
+    plane_.w = -plane_.w;
+    if (front_) {
+      front_->Invert();
+    }
+    if (back_) {
+      back_->Invert();
+    }
+    std::swap(front_, back_);
+  }
+
+  // Returns the parts of facets which are outside of this solid. Parts in the plane of one of its
+  // faces and facing the same way are kept if keep_coplanar is set and removed otherwise. Parts
+  // facing the opposite way are always removed.
+  std::vector<Facet> Clip(const std::vector<Facet>& facets, bool keep_coplanar) const {
+    if (!has_plane_) {
+      return facets;
+    }
+    std::vector<Facet> front;
+    std::vector<Facet> back;
+    for (const Facet& facet : facets) {
+      SplitFacet(plane_, facet, keep_coplanar ? &front : &back, &back, &front, &back);
+    }
+    if (front_) {
+      front = front_->Clip(front, keep_coplanar);
+    }
+    if (back_) {
+      back = back_->Clip(back, keep_coplanar);
+      front.insert(front.end(),
+                   std::make_move_iterator(back.begin()),
+                   std::make_move_iterator(back.end()));
+    }
+    return front;
+  }
+
+  // Removes the parts of this tree's facets which are inside of other.
+  void ClipTo(const BspNode& other) {
+    polygons_ = other.Clip(polygons_, true);
+    if (front_) {
+      front_->ClipTo(other);
+    }
+    if (back_) {
+      back_->ClipTo(other);
+    }
+  }
+
+  void AllPolygons(std::vector<Facet>* facets) const {
+    facets->insert(facets->end(), polygons_.begin(), polygons_.end());
+    if (front_) {
+      front_->AllPolygons(facets);
+    }
+    if (back_) {
+      back_->AllPolygons(facets);
+    }
+  }
+
+  void Build(std::vector<Facet> facets) {
+    if (facets.empty()) {
+      return;
+    }
+    size_t first = 0;
+    if (!has_plane_) {
+      plane_ = facets[0].plane;
+      has_plane_ = true;
+      // Kept as it is even if its vertices are not all within kCsgEpsilon of its plane, splitting
+      // it by its own plane would never end.
+      polygons_.push_back(std::move(facets[0]));
+      first = 1;
+    }
+    std::vector<Facet> front;
+    std::vector<Facet> back;
+    for (size_t i = first; i < facets.size(); ++i) {
+      SplitFacet(plane_, facets[i], &polygons_, &polygons_, &front, &back);
+    }
+    if (!front.empty()) {
+      if (!front_) {
+        front_ = std::make_unique<BspNode>(std::move(front));
+      } else {
+        front_->Build(std::move(front));
+      }
+    }
+    if (!back.empty()) {
+      if (!back_) {
+        back_ = std::make_unique<BspNode>(std::move(back));
+      } else {
+        back_->Build(std::move(back));
+      }
+    }
+  }
+
+ private:
+  bool has_plane_ = false;
+  Plane plane_;
+  std::vector<Facet> polygons_;
+  std::unique_ptr<BspNode> front_;
+  std::unique_ptr<BspNode> back_;
+};
+
+Solid SolidFromTree(const BspNode& tree) {
+  std::vector<Facet> facets;
+  tree.AllPolygons(&facets);
+  return MakeSolid(std::move(facets), false);
+}
+
+// Twice the signed area of the triangle a, b, c.
+double Cross2(const glm::dvec2& a, const glm::dvec2& b, const glm::dvec2& c) {
+  glm::dvec2 u = b - a;
+  glm::dvec2 v = c - a;
+  return u.x * v.y - u.y * v.x;
+}
+
+// Coordinates of points in the plane with the given normal, oriented so that counter clockwise
+// around normal stays counter clockwise.
+std::vector<glm::dvec2> ProjectToPlane(const std::vector<glm::dvec3>& points,
+                                       const glm::dvec3& normal) {
+  glm::dvec3 a = glm::abs(normal);
+  int axis = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+  int u = (axis + 1) % 3;
+  int v = (axis + 2) % 3;
+  if (normal[axis] < 0) {
+    std::swap(u, v);
+  }
+  std::vector<glm::dvec2> projected;
+  projected.reserve(points.size());
+  for (const glm::dvec3& p : points) {
+    projected.emplace_back(p[u], p[v]);
+  }
+  return projected;
+}
+
+// Merges the coplanar triangles of a convex mesh into one facet per face.
+std::vector<Facet> ConvexFaces(const Mesh& mesh) {
+  struct Face {
+    Plane plane;
+    std::vector<glm::dvec3> points;
+  };
+  std::vector<Face> faces;
+  for (const auto& t : mesh.triangles) {
+    std::vector<glm::dvec3> vertices = {
+        mesh.vertices[t[0]], mesh.vertices[t[1]], mesh.vertices[t[2]]};
+    glm::dvec3 normal = AreaNormal(vertices);
+    double length = glm::length(normal);
+    if (length < kMinArea) {
+      continue;
+    }
+    normal /= length;
+    Face* face = nullptr;
+    for (Face& f : faces) {
+      bool in_plane = glm::dot(f.plane.normal, normal) > 1 - 1e-9;
+      for (const glm::dvec3& v : vertices) {
+        in_plane = in_plane && std::abs(glm::dot(f.plane.normal, v) - f.plane.w) < kCsgEpsilon;
+      }
+      if (in_plane) {
+        face = &f;
+        break;
+      }
+    }
+    if (face == nullptr) {
+      faces.push_back({MakePlane(normal, vertices[0]), {}});
+      face = &faces.back();
+    }
+    face->points.insert(face->points.end(), vertices.begin(), vertices.end());
+  }
+
+  std::vector<Facet> facets;
+  for (const Face& face : faces) {
+    // The face is the convex hull of its points.
+    std::vector<int> hull = ConvexHull2d(ProjectToPlane(face.points, face.plane.normal));
+    if (hull.empty()) {
+      continue;
+    }
+    Facet facet;
+    facet.plane = face.plane;
+    for (int i : hull) {
+      facet.vertices.push_back(face.points[i]);
+    }
+    facets.push_back(std::move(facet));
+  }
+  return facets;
+}
+
+// Merges vertices which are within kWeldDistance of each other.
+class VertexWelder {
+ public:
+  int Add(const glm::dvec3& p) {
+    Cell cell = GetCell(p);
+    for (int dx = -1; dx <= 1; ++dx) {
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dz = -1; dz <= 1; ++dz) {
+          auto it = cells_.find(Cell{cell.x + dx, cell.y + dy, cell.z + dz});
+          if (it == cells_.end()) {
+            continue;
+          }
+          for (int index : it->second) {
+            if (glm::length(vertices_[index] - p) < kWeldDistance) {
+              return index;
+            }
+          }
+        }
+      }
+    }
+    int index = vertices_.size();
+    vertices_.push_back(p);
+    cells_[cell].push_back(index);
+    return index;
+  }
+
+  const std::vector<glm::dvec3>& vertices() const {
+    return vertices_;
+  }
+
+ private:
+  struct Cell {
+    int64_t x;
+    int64_t y;
+    int64_t z;
+    bool operator==(const Cell& other) const {
+      return x == other.x && y == other.y && z == other.z;
+    }
+  };
+  struct CellHash {
+    size_t operator()(const Cell& c) const {
+      return std::hash<int64_t>()(c.x * 73856093 ^ c.y * 19349663 ^ c.z * 83492791);
+    }
+  };
+
+  static Cell GetCell(const glm::dvec3& p) {
+    glm::dvec3 c = glm::floor(p / kWeldDistance);
+    return Cell{static_cast<int64_t>(c.x), static_cast<int64_t>(c.y), static_cast<int64_t>(c.z)};
+  }
+
+  std::vector<glm::dvec3> vertices_;
+  std::unordered_map<Cell, std::vector<int>, CellHash> cells_;
+};
+
+// Returns the vertices which lie on the segment from a to b, ordered from a to b. sorted_x must
+// hold every vertex index ordered by x coordinate.
+std::vector<int> VerticesOnEdge(int a,
+                                int b,
+                                const std::vector<glm::dvec3>& vertices,
+                                const std::vector<int>& sorted_x) {
+  const glm::dvec3& pa = vertices[a];
+  const glm::dvec3& pb = vertices[b];
+  glm::dvec3 d = pb - pa;
+  double length2 = glm::dot(d, d);
+  if (length2 == 0) {
+    return {};
+  }
+  double min_x = std::min(pa.x, pb.x) - kWeldDistance;
+  double max_x = std::max(pa.x, pb.x) + kWeldDistance;
+  auto it = std::lower_bound(sorted_x.begin(), sorted_x.end(), min_x, [&](int i, double x) {
+    return vertices[i].x < x;
+  });
+  std::vector<std::pair<double, int>> found;
+  for (; it != sorted_x.end() && vertices[*it].x <= max_x; ++it) {
+    int v = *it;
+    if (v == a || v == b) {
+      continue;
+    }
+    const glm::dvec3& p = vertices[v];
+    double t = glm::dot(p - pa, d) / length2;
+    if (t <= 0 || t >= 1) {
+      continue;
+    }
+    if (glm::length(pa + d * t - p) < kWeldDistance) {
+      found.emplace_back(t, v);
+    }
+  }
+  std::sort(found.begin(), found.end());
+  std::vector<int> result;
+  for (const auto& f : found) {
+    result.push_back(f.second);
+  }
+  return result;
+}
+
+// Fills the holes left where the two sides of an intersection curve were clipped slightly
+// differently. Such holes have almost no area, but without them the mesh is not closed.
+void FillHoles(Mesh* mesh) {
+  std::unordered_map<uint64_t, int> edges;
+  for (const auto& t : mesh->triangles) {
+    for (int i = 0; i < 3; ++i) {
+      ++edges[EdgeKey(t[i], t[(i + 1) % 3])];
+    }
+  }
+  // Edges which are used more often than their reverse, which is where the boundaries of holes are.
+  std::unordered_map<int, std::vector<int>> open;
+  for (const auto& edge : edges) {
+    int a = edge.first >> 32;
+    int b = edge.first & 0xffffffff;
+    auto reverse = edges.find(EdgeKey(b, a));
+    int extra = edge.second - (reverse == edges.end() ? 0 : reverse->second);
+    for (int i = 0; i < extra; ++i) {
+      open[a].push_back(b);
+    }
+  }
+
+  auto fill = [&](const std::vector<int>& loop) {
+    // The hole is the loop walked backwards.
+    std::vector<int> hole(loop.rbegin(), loop.rend());
+    std::vector<glm::dvec3> points;
+    for (int v : hole) {
+      points.push_back(mesh->vertices[v]);
+    }
+    std::vector<std::array<int, 3>> triangles = Triangulate(points, AreaNormal(points));
+    if (triangles.size() + 2 != hole.size()) {
+      // Too thin to triangulate properly, a fan still closes it.
+      triangles.clear();
+      for (size_t i = 1; i + 1 < hole.size(); ++i) {
+        triangles.push_back({0, static_cast<int>(i), static_cast<int>(i + 1)});
+      }
+    }
+    for (const auto& t : triangles) {
+      mesh->triangles.push_back({hole[t[0]], hole[t[1]], hole[t[2]]});
+    }
+  };
+
+  // Walk the open edges, splitting off a loop whenever the walk gets back to a vertex on it.
+  std::vector<int> starts;
+  for (const auto& start : open) {
+    starts.push_back(start.first);
+  }
+  std::sort(starts.begin(), starts.end());
+  for (int start : starts) {
+    std::vector<int> path;
+    std::unordered_map<int, size_t> on_path;
+    int v = start;
+    while (true) {
+      auto it = on_path.find(v);
+      if (it != on_path.end()) {
+        size_t loop_start = it->second;
+        std::vector<int> loop(path.begin() + loop_start, path.end());
+        for (int u : loop) {
+          on_path.erase(u);
+        }
+        path.resize(loop_start);
+        if (loop.size() >= 3) {
+          fill(loop);
+        }
+      }
+      // Looked up without inserting, the walk must not add to open while it is being read.
+      auto found = open.find(v);
+      if (found == open.end() || found->second.empty()) {
+        break;
+      }
+      std::vector<int>& next = found->second;
+      on_path[v] = path.size();
+      path.push_back(v);
+      v = next.back();
+      next.pop_back();
+    }
+  }
+}
+
+// Drops triangles which repeat a vertex, and pairs of triangles over the same vertices which face
+// opposite ways. Neither encloses any volume, but both leave edges with more than one twin.
+void DropEmptyTriangles(Mesh* mesh) {
+  // The triangles over each set of vertices, split by which way they face.
+  std::map<std::array<int, 3>, std::array<std::vector<size_t>, 2>> by_vertices;
+  for (size_t i = 0; i < mesh->triangles.size(); ++i) {
+    std::array<int, 3> t = mesh->triangles[i];
+    if (t[0] == t[1] || t[1] == t[2] || t[2] == t[0]) {
+      continue;
+    }
+    // Rotated so the smallest index comes first, which keeps the winding.
+    std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+    int side = t[1] < t[2] ? 0 : 1;
+    if (side == 1) {
+      std::swap(t[1], t[2]);
+    }
+    by_vertices[t][side].push_back(i);
+  }
+  std::vector<bool> keep(mesh->triangles.size());
+  for (const auto& entry : by_vertices) {
+    const std::vector<size_t>& front = entry.second[0];
+    const std::vector<size_t>& back = entry.second[1];
+    size_t cancelled = std::min(front.size(), back.size());
+    for (size_t i = cancelled; i < front.size(); ++i) {
+      keep[front[i]] = true;
+    }
+    for (size_t i = cancelled; i < back.size(); ++i) {
+      keep[back[i]] = true;
+    }
+  }
+  std::vector<std::array<int, 3>> triangles;
+  for (size_t i = 0; i < mesh->triangles.size(); ++i) {
+    if (keep[i]) {
+      triangles.push_back(mesh->triangles[i]);
+    }
+  }
+  mesh->triangles = std::move(triangles);
+}
+
+// Clipping leaves slivers along intersection curves, where the two sides were cut at points a
+// little apart. They fold over their neighbors, so some edges end up shared by more than two
+// triangles. Edges shorter than kSliverSize are collapsed, and caps (triangles whose third vertex
+// is within kSliverSize of their longest edge) are removed by flipping that edge with the triangle
+// on its other side. Neither moves the surface by more than kSliverSize.
+void RemoveSlivers(Mesh* mesh) {
+  std::vector<int> merged(mesh->vertices.size());
+  std::iota(merged.begin(), merged.end(), 0);
+  auto find = [&](int v) {
+    while (merged[v] != v) {
+      merged[v] = merged[merged[v]];
+      v = merged[v];
+    }
+    return v;
+  };
+  for (const auto& t : mesh->triangles) {
+    for (int i = 0; i < 3; ++i) {
+      int a = find(t[i]);
+      int b = find(t[(i + 1) % 3]);
+      if (a != b && glm::length(mesh->vertices[a] - mesh->vertices[b]) < kSliverSize) {
+        merged[std::max(a, b)] = std::min(a, b);
+      }
+    }
+  }
+  for (auto& t : mesh->triangles) {
+    for (int& v : t) {
+      v = find(v);
+    }
+  }
+  DropEmptyTriangles(mesh);
+
+  // Returns the index of the longest edge of t if t is a cap, or -1 if it is not.
+  auto find_cap = [&](const std::array<int, 3>& t) {
+    int longest = 0;
+    double length = 0;
+    for (int i = 0; i < 3; ++i) {
+      double l = glm::length(mesh->vertices[t[(i + 1) % 3]] - mesh->vertices[t[i]]);
+      if (l > length) {
+        length = l;
+        longest = i;
+      }
+    }
+    const glm::dvec3& a = mesh->vertices[t[longest]];
+    const glm::dvec3& b = mesh->vertices[t[(longest + 1) % 3]];
+    const glm::dvec3& c = mesh->vertices[t[(longest + 2) % 3]];
+    return glm::length(glm::cross(b - a, c - a)) < kSliverSize * length ? longest : -1;
+  };
+  // A flip never makes a cap on the edge it creates, so caps are not flipped back and forth, but
+  // it can make new caps elsewhere. Those are flipped in the next pass.
+  for (int pass = 0; pass < 10; ++pass) {
+    // The triangle on the left of each directed edge, or -1 if there is more than one.
+    std::unordered_map<uint64_t, int> edges;
+    edges.reserve(3 * mesh->triangles.size());
+    for (size_t i = 0; i < mesh->triangles.size(); ++i) {
+      const auto& t = mesh->triangles[i];
+      for (int j = 0; j < 3; ++j) {
+        auto inserted = edges.emplace(EdgeKey(t[j], t[(j + 1) % 3]), static_cast<int>(i));
+        if (!inserted.second) {
+          inserted.first->second = -1;
+        }
+      }
+    }
+    std::vector<bool> flipped(mesh->triangles.size());
+    bool changed = false;
+    for (size_t i = 0; i < mesh->triangles.size(); ++i) {
+      int longest = flipped[i] ? -1 : find_cap(mesh->triangles[i]);
+      if (longest < 0) {
+        continue;
+      }
+      const auto& t = mesh->triangles[i];
+      int a = t[longest];
+      int b = t[(longest + 1) % 3];
+      int c = t[(longest + 2) % 3];
+      // Only flip where the edge is shared by exactly two triangles.
+      auto twin = edges.find(EdgeKey(b, a));
+      if (twin == edges.end() || twin->second < 0 || edges[EdgeKey(a, b)] < 0 ||
+          flipped[twin->second]) {
+        continue;
+      }
+      int other = twin->second;
+      int d = -1;
+      for (int v : mesh->triangles[other]) {
+        if (v != a && v != b) {
+          d = v;
+        }
+      }
+      // The new edge goes from d to c in the first triangle and back in the second.
+      std::array<int, 3> first = {c, a, d};
+      std::array<int, 3> second = {b, c, d};
+      if (d == c || find_cap(first) == 2 || find_cap(second) == 1) {
+        continue;
+      }
+      mesh->triangles[i] = first;
+      mesh->triangles[other] = second;
+      flipped[i] = true;
+      flipped[other] = true;
+      changed = true;
+    }
+    if (!changed) {
+      break;
+    }
+  }
+  DropEmptyTriangles(mesh);
+}
+
+}  // namespace
+
+bool Box::Overlaps(const Box& box) const {
+  return min.x <= box.max.x + kCsgEpsilon && box.min.x <= max.x + kCsgEpsilon &&
+         min.y <= box.max.y + kCsgEpsilon && box.min.y <= max.y + kCsgEpsilon &&
+         min.z <= box.max.z + kCsgEpsilon && box.min.z <= max.z + kCsgEpsilon;
+}
+
+std::vector<std::array<int, 3>> Triangulate(const std::vector<glm::dvec3>& vertices,
+                                            const glm::dvec3& normal) {
+  std::vector<std::array<int, 3>> triangles;
+  std::vector<glm::dvec2> p = ProjectToPlane(vertices, normal);
+  std::vector<int> remaining(vertices.size());
+  std::iota(remaining.begin(), remaining.end(), 0);
+
+  while (remaining.size() > 3) {
+    const size_t n = remaining.size();
+    bool clipped = false;
+    for (size_t k = 0; k < n && !clipped; ++k) {
+      int prev = remaining[(k + n - 1) % n];
+      int cur = remaining[k];
+      int next = remaining[(k + 1) % n];
+      if (Cross2(p[prev], p[cur], p[next]) <= kMinArea) {
+        continue;
+      }
+      bool is_ear = true;
+      for (int other : remaining) {
+        if (other == prev || other == cur || other == next) {
+          continue;
+        }
+        // Vertices on the new edge from next to prev block the ear as well, otherwise collinear
+        // vertices would be skipped by it and leave a T junction.
+        if (Cross2(p[prev], p[cur], p[other]) > kMinArea &&
+            Cross2(p[cur], p[next], p[other]) > kMinArea &&
+            Cross2(p[next], p[prev], p[other]) >= -kMinArea) {
+          is_ear = false;
+          break;
+        }
+      }
+      if (is_ear) {
+        triangles.push_back({prev, cur, next});
+        remaining.erase(remaining.begin() + k);
+        clipped = true;
+      }
+    }
+    if (!clipped) {
+      // Only collinear or reflex vertices are left, which means what remains has no area.
+      break;
+    }
+  }
+  if (remaining.size() == 3 &&
+      Cross2(p[remaining[0]], p[remaining[1]], p[remaining[2]]) > kMinArea) {
+    triangles.push_back({remaining[0], remaining[1], remaining[2]});
+  }
+  return triangles;
+}
+
+void AddFacet(const std::vector<glm::dvec3>& vertices, std::vector<Facet>* facets) {
+  std::vector<glm::dvec3> unique;
+  unique.reserve(vertices.size());
+  for (const glm::dvec3& v : vertices) {
+    if (unique.empty() || glm::length(unique.back() - v) >= kCsgEpsilon) {
+      unique.push_back(v);
+    }
+  }
+  while (unique.size() > 1 && glm::length(unique.back() - unique.front()) < kCsgEpsilon) {
+    unique.pop_back();
+  }
+  if (unique.size() < 3) {
+    return;
+  }
+  glm::dvec3 normal = AreaNormal(unique);
+  double length = glm::length(normal);
+  if (length < kMinArea) {
+    return;
+  }
+  normal /= length;
+
+  bool convex = true;
+  for (size_t i = 0; i < unique.size() && convex; ++i) {
+    const glm::dvec3& a = unique[i];
+    const glm::dvec3& b = unique[(i + 1) % unique.size()];
+    const glm::dvec3& c = unique[(i + 2) % unique.size()];
+    convex = glm::dot(glm::cross(b - a, c - b), normal) >= -kMinArea;
+  }
+  if (convex) {
+    facets->push_back({std::move(unique), MakePlane(normal, vertices[0])});
+    return;
+  }
+  for (const auto& t : Triangulate(unique, normal)) {
+    AddFacet({unique[t[0]], unique[t[1]], unique[t[2]]}, facets);
+  }
+}
+
+Solid MakeSolid(const Mesh& mesh, bool convex) {
+  if (convex) {
+    return MakeSolid(ConvexFaces(mesh), true);
+  }
+  std::vector<Facet> facets;
+  facets.reserve(mesh.triangles.size());
+  for (const auto& t : mesh.triangles) {
+    AddFacet({mesh.vertices[t[0]], mesh.vertices[t[1]], mesh.vertices[t[2]]}, &facets);
+  }
+  return MakeSolid(std::move(facets), false);
+}
+
+Solid MakeSolid(std::vector<Facet> facets, bool convex) {
+  Solid solid;
+  solid.facets = std::move(facets);
+  solid.convex = convex;
+  for (const Facet& facet : solid.facets) {
+    for (const glm::dvec3& v : facet.vertices) {
+      solid.box.Add(v);
+    }
+  }
+  return solid;
+}
+
+Solid TransformSolid(const Solid& solid, const glm::dmat4& m) {
+  glm::dmat3 linear(m);
+  bool mirrored = glm::determinant(linear) < 0;
+  glm::dmat3 normal_matrix = glm::transpose(glm::inverse(linear));
+  Solid result;
+  result.convex = solid.convex;
+  result.facets.reserve(solid.facets.size());
+  for (const Facet& facet : solid.facets) {
+    Facet p;
+    p.vertices.reserve(facet.vertices.size());
+    for (const glm::dvec3& v : facet.vertices) {
+      p.vertices.push_back(glm::dvec3(m * glm::dvec4(v, 1)));
+      result.box.Add(p.vertices.back());
+    }
+    if (mirrored) {
+      std::reverse(p.vertices.begin(), p.vertices.end());
+    }
+    p.plane = MakePlane(glm::normalize(normal_matrix * facet.plane.normal), p.vertices[0]);
+    result.facets.push_back(std::move(p));
+  }
+  return result;
+}
+
+Solid Subtract(const Solid& a, const Solid& b) {
+  if (!a.box.Overlaps(b.box)) {
+    return a;
+  }
+  BspNode ta(a.facets);
+  BspNode tb(b.facets);
+  ta.Invert();
+  ta.ClipTo(tb);
+  tb.ClipTo(ta);
+  tb.Invert();
+  tb.ClipTo(ta);
+  tb.Invert();
+  std::vector<Facet> facets;
+  tb.AllPolygons(&facets);
+  ta.Build(std::move(facets));
+  ta.Invert();
+  return SolidFromTree(ta);
+}
+
+Solid Intersect(const Solid& a, const Solid& b) {
+  if (!a.box.Overlaps(b.box)) {
+    return Solid();
+  }
+  BspNode ta(a.facets);
+  BspNode tb(b.facets);
+  ta.Invert();
+  tb.ClipTo(ta);
+  tb.Invert();
+  ta.ClipTo(tb);
+  tb.ClipTo(ta);
+  std::vector<Facet> facets;
+  tb.AllPolygons(&facets);
+  ta.Build(std::move(facets));
+  ta.Invert();
+  Solid result = SolidFromTree(ta);
+  result.convex = a.convex && b.convex;
+  return result;
+}
+
+std::vector<Facet> UnionBoundary(const std::vector<Solid>& solids) {
+  // Find the pairs of overlapping solids by sweeping along x.
+  const size_t n = solids.size();
+  std::vector<int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return solids[a].box.min.x < solids[b].box.min.x;
+  });
+  std::vector<std::vector<int>> overlaps(n);
+  for (size_t i = 0; i < n; ++i) {
+    const Solid& a = solids[order[i]];
+    for (size_t j = i + 1; j < n; ++j) {
+      const Solid& b = solids[order[j]];
+      if (b.box.min.x > a.box.max.x + kCsgEpsilon) {
+        break;
+      }
+      if (a.box.Overlaps(b.box)) {
+        overlaps[order[i]].push_back(order[j]);
+        overlaps[order[j]].push_back(order[i]);
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<BspNode>> trees(n);
+  std::vector<Facet> result;
+  for (size_t i = 0; i < n; ++i) {
+    std::vector<Facet> facets = solids[i].facets;
+    // Clipping against solids in order keeps the output independent of the sweep order.
+    std::sort(overlaps[i].begin(), overlaps[i].end());
+    for (int j : overlaps[i]) {
+      if (facets.empty()) {
+        break;
+      }
+      if (!trees[j]) {
+        trees[j] = std::make_unique<BspNode>(solids[j].facets);
+      }
+      // Only facets which reach into j's box can be affected by it.
+      std::vector<Facet> near;
+      std::vector<Facet> far;
+      for (Facet& facet : facets) {
+        (FacetBox(facet).Overlaps(solids[j].box) ? near : far).push_back(std::move(facet));
+      }
+      // Where the solids share a face only the earlier one keeps it.
+      facets = trees[j]->Clip(near, i < static_cast<size_t>(j));
+      facets.insert(facets.end(),
+                    std::make_move_iterator(far.begin()),
+                    std::make_move_iterator(far.end()));
+    }
+    result.insert(result.end(),
+                  std::make_move_iterator(facets.begin()),
+                  std::make_move_iterator(facets.end()));
+  }
+  return result;
+}
+
+Mesh FacetsToMesh(const std::vector<Facet>& facets) {
+  VertexWelder welder;
+  std::vector<std::vector<int>> faces;
+  faces.reserve(facets.size());
+  for (const Facet& facet : facets) {
+    std::vector<int> face;
+    for (const glm::dvec3& v : facet.vertices) {
+      int index = welder.Add(v);
+      if (face.empty() || face.back() != index) {
+        face.push_back(index);
+      }
+    }
+    while (face.size() > 1 && face.back() == face.front()) {
+      face.pop_back();
+    }
+    faces.push_back(std::move(face));
+  }
+  const std::vector<glm::dvec3>& vertices = welder.vertices();
+
+  // Every edge of a closed mesh has a twin going the other way. Edges without one are where
+  // clipping left a T junction.
+  std::unordered_map<uint64_t, int> edges;
+  for (const auto& face : faces) {
+    for (size_t i = 0; i < face.size(); ++i) {
+      ++edges[EdgeKey(face[i], face[(i + 1) % face.size()])];
+    }
+  }
+  std::vector<int> sorted_x(vertices.size());
+  std::iota(sorted_x.begin(), sorted_x.end(), 0);
+  std::sort(sorted_x.begin(), sorted_x.end(), [&](int a, int b) {
+    return vertices[a].x < vertices[b].x;
+  });
+
+  Mesh mesh;
+  mesh.vertices = vertices;
+  for (size_t f = 0; f < faces.size(); ++f) {
+    const std::vector<int>& face = faces[f];
+    if (face.size() < 3) {
+      continue;
+    }
+    std::vector<int> split;
+    for (size_t i = 0; i < face.size(); ++i) {
+      int a = face[i];
+      int b = face[(i + 1) % face.size()];
+      split.push_back(a);
+      if (edges.find(EdgeKey(b, a)) == edges.end()) {
+        std::vector<int> on_edge = VerticesOnEdge(a, b, vertices, sorted_x);
+        split.insert(split.end(), on_edge.begin(), on_edge.end());
+      }
+    }
+    std::vector<glm::dvec3> points;
+    points.reserve(split.size());
+    for (int v : split) {
+      points.push_back(vertices[v]);
+    }
+    for (const auto& t : Triangulate(points, facets[f].plane.normal)) {
+      mesh.triangles.push_back({split[t[0]], split[t[1]], split[t[2]]});
+    }
+  }
+  FillHoles(&mesh);
+  RemoveSlivers(&mesh);
+  return mesh;
+}
+
+}  // namespace scad
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "mesh.h"
+
+namespace scad {
+
+// Points closer than this to a plane are treated as being on it.
+const double kCsgEpsilon = 1e-5;
+
+struct Plane {
+  glm::dvec3 normal;
+  // The plane is dot(normal, p) == w.
+  double w = 0;
+};
+
+// A convex planar polygon. Vertices are counter clockwise when seen from the front of the plane.
+struct Facet {
+  std::vector<glm::dvec3> vertices;
+  Plane plane;
+};
+
+struct Box {
+  glm::dvec3 min = glm::dvec3(1e300);
+  glm::dvec3 max = glm::dvec3(-1e300);
+
+  bool empty() const {
+    return min.x > max.x;
+  }
+  void Add(const glm::dvec3& p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+  void Add(const Box& box) {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+  }
+  // Boxes which only touch within kCsgEpsilon count as overlapping.
+  bool Overlaps(const Box& box) const;
+};
+
+// A closed solid bounded by facets which face outwards.
+struct Solid {
+  std::vector<Facet> facets;
+  Box box;
+  // Set for solids which are known to be convex, which lets some operations skip work.
+  bool convex = false;
+};
+
+// Builds a facet for vertices, which must be planar and counter clockwise when seen from
+// outside. Non convex or degenerate input is split into triangles and zero area pieces are dropped.
+void AddFacet(const std::vector<glm::dvec3>& vertices, std::vector<Facet>* facets);
+
+Solid MakeSolid(const Mesh& mesh, bool convex);
+Solid MakeSolid(std::vector<Facet> facets, bool convex);
+// Applies the affine transform m to solid. Transforms which mirror also flip the facets so they
+// keep facing outwards.
+Solid TransformSolid(const Solid& solid, const glm::dmat4& m);
+
+// Boolean operations on two solids, using BSP trees.
+Solid Subtract(const Solid& a, const Solid& b);
+Solid Intersect(const Solid& a, const Solid& b);
+
+// Returns the boundary of the union of solids, which may overlap each other. Every solid is only
+// clipped against the solids whose bounding boxes overlap its own, so this scales with the number
+// of overlapping pairs rather than with the total size of the result.
+std::vector<Facet> UnionBoundary(const std::vector<Solid>& solids);
+
+// Triangulates facets into a mesh. Vertices which are very close to each other are merged and
+// edges which pass through vertices of neighboring facets (T junctions left by clipping) are
+// split at them, so the result is a closed mesh whenever the facets bound a closed solid. Slivers
+// left by clipping are removed, which leaves almost every edge shared by exactly two triangles,
+// but where they fold over each other a handful of edges can still be shared by more.
+Mesh FacetsToMesh(const std::vector<Facet>& facets);
+
+// Splits a simple planar polygon into triangles by ear clipping. normal is the side the polygon is
+// counter clockwise from. Collinear vertices never produce zero area triangles.
+std::vector<std::array<int, 3>> Triangulate(const std::vector<glm::dvec3>& vertices,
+                                            const glm::dvec3& normal);
+
+}  // namespace scad
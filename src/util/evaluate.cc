@@ -0,0 +1,473 @@
+#include "evaluate.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "csg.h"
+#include "hull.h"
+#include "mesh.h"
+#include "scad.h"
+#include "stl.h"
+#include "transform.h"
+
+namespace scad {
+namespace {
+
+// A simple 2D polygon, counter clockwise.
+struct Outline {
+  std::vector<glm::dvec2> points;
+  bool convex = false;
+};
+
+// The result of evaluating a node: the union of all of the solids and outlines. They are only
+// merged at the very end since transforms, differences, intersections, projections and extrusions
+// all distribute over union and are much cheaper on the small pieces.
+struct Geometry {
+  std::vector<Solid> solids;
+  std::vector<Outline> outlines;
+};
+
+using GeometryPtr = std::shared_ptr<const Geometry>;
+
+double SignedArea(const std::vector<glm::dvec2>& points) {
+  double area = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    const glm::dvec2& a = points[i];
+    const glm::dvec2& b = points[(i + 1) % points.size()];
+    area += a.x * b.y - a.y * b.x;
+  }
+  return area / 2;
+}
+
+bool IsConvex(const std::vector<glm::dvec2>& points) {
+  for (size_t i = 0; i < points.size(); ++i) {
+    glm::dvec2 u = points[(i + 1) % points.size()] - points[i];
+    glm::dvec2 v = points[(i + 2) % points.size()] - points[(i + 1) % points.size()];
+    if (u.x * v.y - u.y * v.x < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Adds the outline for points, in either winding. Outlines without area are dropped.
+void AddOutline(std::vector<glm::dvec2> points, Geometry* geometry) {
+  double area = SignedArea(points);
+  if (std::abs(area) < kCsgEpsilon * kCsgEpsilon) {
+    return;
+  }
+  if (area < 0) {
+    std::reverse(points.begin(), points.end());
+  }
+  bool convex = IsConvex(points);
+  geometry->outlines.push_back({std::move(points), convex});
+}
+
+void AddConvexOutline(const std::vector<glm::dvec2>& points, Geometry* geometry) {
+  std::vector<int> hull = ConvexHull2d(points);
+  if (hull.empty()) {
+    return;
+  }
+  Outline outline;
+  outline.convex = true;
+  for (int i : hull) {
+    outline.points.push_back(points[i]);
+  }
+  geometry->outlines.push_back(std::move(outline));
+}
+
+// Returns false if the hull of points could not be computed.
+bool AddConvexSolid(const std::vector<glm::dvec3>& points, Geometry* geometry) {
+  // Points which do not span a volume (for example a cylinder with no height) give nothing.
+  if (!SpansVolume(points)) {
+    return true;
+  }
+  Mesh hull;
+  if (!ConvexHull(points, &hull)) {
+    return false;
+  }
+  geometry->solids.push_back(MakeSolid(hull, true));
+  return true;
+}
+
+void AddVertices(const Solid& solid, std::vector<glm::dvec3>* points) {
+  for (const Facet& facet : solid.facets) {
+    points->insert(points->end(), facet.vertices.begin(), facet.vertices.end());
+  }
+}
+
+Solid ExtrudeOutline(const Outline& outline, double height, bool center, double scale) {
+  double z0 = center ? -height / 2 : 0;
+  double z1 = z0 + height;
+  const std::vector<glm::dvec2>& points = outline.points;
+  const size_t n = points.size();
+  std::vector<glm::dvec3> bottom;
+  std::vector<glm::dvec3> top;
+  for (const glm::dvec2& p : points) {
+    bottom.emplace_back(p, z0);
+    top.emplace_back(p * scale, z1);
+  }
+  std::vector<Facet> facets;
+  AddFacet(top, &facets);
+  std::reverse(bottom.begin(), bottom.end());
+  AddFacet(bottom, &facets);
+  std::reverse(bottom.begin(), bottom.end());
+  for (size_t i = 0; i < n; ++i) {
+    size_t j = (i + 1) % n;
+    AddFacet({bottom[i], bottom[j], top[j], top[i]}, &facets);
+  }
+  return MakeSolid(std::move(facets), outline.convex);
+}
+
+void ProjectSolid(const Solid& solid, Geometry* geometry) {
+  if (solid.convex) {
+    std::vector<glm::dvec2> points;
+    for (const Facet& facet : solid.facets) {
+      for (const glm::dvec3& v : facet.vertices) {
+        points.emplace_back(v.x, v.y);
+      }
+    }
+    AddConvexOutline(points, geometry);
+    return;
+  }
+  // The faces which point up cover the whole shadow of the solid.
+  for (const Facet& facet : solid.facets) {
+    if (facet.plane.normal.z <= kCsgEpsilon) {
+      continue;
+    }
+    std::vector<glm::dvec2> points;
+    for (const glm::dvec3& v : facet.vertices) {
+      points.emplace_back(v.x, v.y);
+    }
+    AddOutline(std::move(points), geometry);
+  }
+}
+
+void Append(const Geometry& from, Geometry* to) {
+  to->solids.insert(to->solids.end(), from.solids.begin(), from.solids.end());
+  to->outlines.insert(to->outlines.end(), from.outlines.begin(), from.outlines.end());
+}
+
+bool EndsWith(const std::string& s, const std::string& suffix) {
+  if (s.size() < suffix.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < suffix.size(); ++i) {
+    if (std::tolower(s[s.size() - suffix.size() + i]) != suffix[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+class Evaluator {
+ public:
+  // Returns null if shape can not be evaluated, see error().
+  GeometryPtr Evaluate(const Shape& shape) {
+    if (shape.empty()) {
+      return std::make_shared<Geometry>();
+    }
+    const Node* node = shape.node();
+    auto it = memo_.find(node);
+    if (it != memo_.end()) {
+      return it->second;
+    }
+    GeometryPtr result = EvaluateNode(shape, *node);
+    if (result) {
+      memo_[node] = result;
+    }
+    return result;
+  }
+
+  const std::string& error() const {
+    return error_;
+  }
+
+ private:
+  GeometryPtr Fail(const Node& node, const std::string& reason) {
+    error_ = std::string(NodeTypeName(node.type)) + ": " + reason;
+    return nullptr;
+  }
+
+  // Evaluates every child of node into result. Returns false if one of them fails.
+  bool EvaluateChildren(const Node& node, std::vector<GeometryPtr>* result) {
+    for (const Shape& child : node.children) {
+      GeometryPtr geometry = Evaluate(child);
+      if (!geometry) {
+        return false;
+      }
+      result->push_back(std::move(geometry));
+    }
+    return true;
+  }
+
+  GeometryPtr EvaluateNode(const Shape& shape, const Node& node) {
+    const std::vector<double>& args = node.args;
+    auto result = std::make_shared<Geometry>();
+    switch (node.type) {
+      case NodeType::CUBE:
+      case NodeType::SPHERE:
+      case NodeType::CYLINDER: {
+        std::vector<glm::dvec3> points;
+        CollectHullPoints(shape, &points);
+        if (!AddConvexSolid(points, result.get())) {
+          return Fail(node,
+                      "could not compute the hull of " + std::to_string(points.size()) + " points");
+        }
+        return result;
+      }
+      case NodeType::SQUARE:
+      case NodeType::CIRCLE: {
+        std::vector<glm::dvec3> points;
+        CollectHullPoints(shape, &points);
+        std::vector<glm::dvec2> points_2d;
+        for (const glm::dvec3& p : points) {
+          points_2d.emplace_back(p.x, p.y);
+        }
+        AddConvexOutline(points_2d, result.get());
+        return result;
+      }
+      case NodeType::POLYGON: {
+        std::vector<glm::dvec2> points;
+        for (size_t i = 0; i + 1 < args.size(); i += 2) {
+          points.emplace_back(args[i], args[i + 1]);
+        }
+        AddOutline(std::move(points), result.get());
+        return result;
+      }
+      case NodeType::POLYHEDRON: {
+        std::vector<glm::dvec3> points;
+        for (size_t i = 1; i + 2 < args.size(); i += 3) {
+          points.emplace_back(args[i], args[i + 1], args[i + 2]);
+        }
+        std::vector<Facet> facets;
+        for (const std::vector<int>& face : node.faces) {
+          // OpenSCAD faces are clockwise when seen from outside.
+          std::vector<glm::dvec3> vertices;
+          for (auto f = face.rbegin(); f != face.rend(); ++f) {
+            if (*f < 0 || *f >= static_cast<int>(points.size())) {
+              return Fail(node, "face index out of range");
+            }
+            vertices.push_back(points[*f]);
+          }
+          AddFacet(vertices, &facets);
+        }
+        result->solids.push_back(MakeSolid(std::move(facets), false));
+        return result;
+      }
+      case NodeType::IMPORT: {
+        if (!EndsWith(node.text, ".stl")) {
+          return Fail(node, "only STL files can be imported (" + node.text + ")");
+        }
+        Mesh mesh;
+        if (!ReadStlFile(node.text, &mesh)) {
+          return Fail(node, "could not read " + node.text);
+        }
+        result->solids.push_back(MakeSolid(mesh, false));
+        return result;
+      }
+      case NodeType::TRANSLATE:
+      case NodeType::ROTATE:
+      case NodeType::ROTATE_AXIS:
+      case NodeType::MIRROR:
+      case NodeType::SCALE:
+      case NodeType::MULTMATRIX: {
+        GeometryPtr child = Evaluate(node.children[0]);
+        if (!child) {
+          return nullptr;
+        }
+        glm::dmat4 m = GetNodeMatrix(node);
+        for (const Solid& solid : child->solids) {
+          result->solids.push_back(TransformSolid(solid, m));
+        }
+        bool mirrored = m[0][0] * m[1][1] - m[0][1] * m[1][0] < 0;
+        for (const Outline& outline : child->outlines) {
+          Outline transformed = outline;
+          for (glm::dvec2& p : transformed.points) {
+            p = glm::dvec2(m * glm::dvec4(p, 0, 1));
+          }
+          if (mirrored) {
+            std::reverse(transformed.points.begin(), transformed.points.end());
+          }
+          result->outlines.push_back(std::move(transformed));
+        }
+        return result;
+      }
+      case NodeType::UNION:
+      case NodeType::COMMENT:
+      case NodeType::COLOR:
+      case NodeType::COLOR_NAME:
+      case NodeType::ALPHA: {
+        std::vector<GeometryPtr> children;
+        if (!EvaluateChildren(node, &children)) {
+          return nullptr;
+        }
+        if (children.size() == 1) {
+          return children[0];
+        }
+        for (const GeometryPtr& child : children) {
+          Append(*child, result.get());
+        }
+        if (!result->solids.empty() && !result->outlines.empty()) {
+          return Fail(node, "mixing 2D and 3D children is not supported");
+        }
+        return result;
+      }
+      case NodeType::DIFFERENCE: {
+        std::vector<GeometryPtr> children;
+        if (!EvaluateChildren(node, &children)) {
+          return nullptr;
+        }
+        if (children.empty()) {
+          return result;
+        }
+        Geometry negative;
+        for (size_t i = 1; i < children.size(); ++i) {
+          Append(*children[i], &negative);
+        }
+        if (!children[0]->outlines.empty() || !negative.outlines.empty()) {
+          return Fail(node, "2D differences are not supported");
+        }
+        // (a0 + a1 + ...) - b is (a0 - b) + (a1 - b) + ..., and each piece only needs the negative
+        // pieces which reach it.
+        for (const Solid& positive : children[0]->solids) {
+          Solid solid = positive;
+          for (const Solid& b : negative.solids) {
+            if (solid.facets.empty()) {
+              break;
+            }
+            solid = Subtract(solid, b);
+          }
+          if (!solid.facets.empty()) {
+            result->solids.push_back(std::move(solid));
+          }
+        }
+        return result;
+      }
+      case NodeType::INTERSECTION: {
+        std::vector<GeometryPtr> children;
+        if (!EvaluateChildren(node, &children)) {
+          return nullptr;
+        }
+        if (children.empty()) {
+          return result;
+        }
+        std::vector<Solid> solids = children[0]->solids;
+        for (size_t i = 0; i < children.size(); ++i) {
+          if (!children[i]->outlines.empty()) {
+            return Fail(node, "2D intersections are not supported");
+          }
+          if (i == 0) {
+            continue;
+          }
+          // Intersection distributes over union as well, so intersect every overlapping pair.
+          std::vector<Solid> next;
+          for (const Solid& a : solids) {
+            for (const Solid& b : children[i]->solids) {
+              Solid solid = Intersect(a, b);
+              if (!solid.facets.empty()) {
+                next.push_back(std::move(solid));
+              }
+            }
+          }
+          solids = std::move(next);
+        }
+        result->solids = std::move(solids);
+        return result;
+      }
+      case NodeType::HULL: {
+        std::vector<GeometryPtr> children;
+        if (!EvaluateChildren(node, &children)) {
+          return nullptr;
+        }
+        Geometry all;
+        for (const GeometryPtr& child : children) {
+          Append(*child, &all);
+        }
+        if (!all.solids.empty() && !all.outlines.empty()) {
+          return Fail(node, "mixing 2D and 3D children is not supported");
+        }
+        if (!all.solids.empty()) {
+          std::vector<glm::dvec3> points;
+          for (const Solid& solid : all.solids) {
+            AddVertices(solid, &points);
+          }
+          if (!AddConvexSolid(points, result.get())) {
+            return Fail(node,
+                      "could not compute the hull of " + std::to_string(points.size()) + " points");
+          }
+        } else {
+          std::vector<glm::dvec2> points;
+          for (const Outline& outline : all.outlines) {
+            points.insert(points.end(), outline.points.begin(), outline.points.end());
+          }
+          AddConvexOutline(points, result.get());
+        }
+        return result;
+      }
+      case NodeType::LINEAR_EXTRUDE: {
+        if (args[3] != 0) {
+          return Fail(node, "twist is not supported");
+        }
+        GeometryPtr child = Evaluate(node.children[0]);
+        if (!child) {
+          return nullptr;
+        }
+        if (!child->solids.empty()) {
+          return Fail(node, "the child must be 2D");
+        }
+        if (args[0] <= 0) {
+          return result;
+        }
+        // Extrusion distributes over union too, so every outline becomes its own prism.
+        for (const Outline& outline : child->outlines) {
+          result->solids.push_back(ExtrudeOutline(outline, args[0], args[1], args[5]));
+        }
+        return result;
+      }
+      case NodeType::PROJECTION: {
+        if (args[0]) {
+          return Fail(node, "cut is not supported");
+        }
+        GeometryPtr child = Evaluate(node.children[0]);
+        if (!child) {
+          return nullptr;
+        }
+        for (const Solid& solid : child->solids) {
+          ProjectSolid(solid, result.get());
+        }
+        return result;
+      }
+      default:
+        return Fail(node, "not supported");
+    }
+  }
+
+  std::unordered_map<const Node*, GeometryPtr> memo_;
+  std::string error_;
+};
+
+}  // namespace
+
+bool EvaluateMesh(const Shape& shape, Mesh* mesh) {
+  Evaluator evaluator;
+  GeometryPtr geometry = evaluator.Evaluate(shape);
+  if (!geometry) {
+    fprintf(stderr, "Could not evaluate mesh: %s\n", evaluator.error().c_str());
+    return false;
+  }
+  if (!geometry->outlines.empty()) {
+    fprintf(stderr, "Could not evaluate mesh: the shape is 2D\n");
+    return false;
+  }
+  *mesh = FacetsToMesh(UnionBoundary(geometry->solids));
+  return true;
+}
+
+}  // namespace scad
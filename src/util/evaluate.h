@@ -0,0 +1,15 @@
+#pragma once
+
+#include "mesh.h"
+#include "scad.h"
+
+namespace scad {
+
+// Evaluates shape to a closed triangle mesh in process, without going through OpenSCAD (see
+// FacetsToMesh for how close to 2-manifold it is). Primitives are tessellated the same way OpenSCAD
+// does it, and transforms, unions, differences, intersections, hulls, linear extrusions without
+// twist and projections without cut are supported. Returns false and prints the reason for
+// anything else, or if the result is not a 3D shape.
+bool EvaluateMesh(const Shape& shape, Mesh* mesh);
+
+}  // namespace scad
@@ -0,0 +1,688 @@
+#include "hull.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh.h"
+#include "scad.h"
+#include "transform.h"
+
+namespace scad {
+namespace {
+
+struct HullFace {
+  std::array<int, 3> v;
+  // Only used to pick the furthest point, visibility is decided by Orientation.
+  glm::dvec3 normal;
+  double offset = 0;
+  std::vector<int> outside;
+  bool deleted = false;
+};
+
+// Points are snapped to a grid of this many steps either side of the center of their bounds for
+// the orientation tests, which keeps the differences below 2^27 so Orientation can be exact.
+const double kGridSteps = 1 << 26;
+// 2D hull corners which turn by less than this (twice the triangle area) are dropped.
+const double kMinHullArea = 1e-12;
+
+using GridPoint = std::array<int64_t, 3>;
+
+uint64_t EdgeKey(int a, int b) {
+  return (static_cast<uint64_t>(a) << 32) | static_cast<uint32_t>(b);
+}
+
+GridPoint Sub(const GridPoint& a, const GridPoint& b) {
+  return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+// Below 2^55 for grid points.
+GridPoint Cross(const GridPoint& u, const GridPoint& v) {
+  return {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]};
+}
+
+// The exact sign of dot(cross(b - a, c - a), d - a): positive when d is in front of the triangle
+// abc, which is counter clockwise when seen from the front, and zero when the four are coplanar.
+int Orientation(const GridPoint& a, const GridPoint& b, const GridPoint& c, const GridPoint& d) {
+  GridPoint k = Cross(Sub(b, a), Sub(c, a));
+  GridPoint w = Sub(d, a);
+  // The dot product can need 84 bits, so each k[i] is split into k[i] >> 28 and its low 28 bits
+  // and the two halves are summed separately.
+  const int64_t kLowMask = (int64_t(1) << 28) - 1;
+  int64_t high = 0;
+  int64_t low = 0;
+  for (int i = 0; i < 3; ++i) {
+    high += (k[i] >> 28) * w[i];
+    low += (k[i] & kLowMask) * w[i];
+  }
+  high += low >> 28;
+  low &= kLowMask;
+  if (high != 0) {
+    return high > 0 ? 1 : -1;
+  }
+  return low > 0 ? 1 : 0;
+}
+
+// Quickhull with exact orientation tests, so coplanar and nearly coplanar points can not make
+// neighboring faces disagree about which side of the hull a point is on.
+class QuickHull {
+ public:
+  QuickHull(const std::vector<glm::dvec3>& points, const std::vector<GridPoint>& grid)
+      : points_(points), grid_(grid) {
+  }
+
+  bool Run(Mesh* hull) {
+    std::array<int, 4> simplex;
+    if (!FindSimplex(&simplex)) {
+      return false;
+    }
+    for (int i = 0; i < 4; ++i) {
+      // Each face of the tetrahedron leaves out one vertex, which must be behind it.
+      std::array<int, 3> v;
+      for (int j = 0, k = 0; j < 4; ++j) {
+        if (j != i) {
+          v[k++] = simplex[j];
+        }
+      }
+      if (Orientation(grid_[v[0]], grid_[v[1]], grid_[v[2]], grid_[simplex[i]]) > 0) {
+        std::swap(v[1], v[2]);
+      }
+      AddFace(v[0], v[1], v[2]);
+    }
+
+    std::vector<int> remaining;
+    for (size_t i = 0; i < points_.size(); ++i) {
+      if (std::find(simplex.begin(), simplex.end(), i) == simplex.end()) {
+        remaining.push_back(i);
+      }
+    }
+    std::vector<int> new_faces = {0, 1, 2, 3};
+    AssignOutside(remaining, new_faces);
+
+    // AssignOutside can give points to faces which were already passed, so keep going until no
+    // face has any points left outside of it.
+    bool added = true;
+    while (added && !broken_) {
+      added = false;
+      for (size_t f = 0; f < faces_.size() && !broken_; ++f) {
+        if (!faces_[f].deleted && !faces_[f].outside.empty()) {
+          AddPoint(f);
+          added = true;
+        }
+      }
+    }
+    return Finish(hull);
+  }
+
+ private:
+  double Distance(const HullFace& face, const glm::dvec3& p) const {
+    return glm::dot(face.normal, p) - face.offset;
+  }
+
+  bool IsOutside(const HullFace& face, int p) const {
+    return Orientation(grid_[face.v[0]], grid_[face.v[1]], grid_[face.v[2]], grid_[p]) > 0;
+  }
+
+  // Picks the simplex by distances, which only need to be roughly right, and then makes sure with
+  // exact tests that it is not flat. Fails if every point is on one plane.
+  bool FindSimplex(std::array<int, 4>* simplex) const {
+    // The two extreme points which are furthest apart.
+    std::array<int, 6> extremes = {0, 0, 0, 0, 0, 0};
+    for (size_t i = 0; i < points_.size(); ++i) {
+      for (int axis = 0; axis < 3; ++axis) {
+        if (points_[i][axis] < points_[extremes[axis * 2]][axis]) {
+          extremes[axis * 2] = i;
+        }
+        if (points_[i][axis] > points_[extremes[axis * 2 + 1]][axis]) {
+          extremes[axis * 2 + 1] = i;
+        }
+      }
+    }
+    double best = -1;
+    for (int a : extremes) {
+      for (int b : extremes) {
+        double d = glm::length(points_[a] - points_[b]);
+        if (d > best) {
+          best = d;
+          (*simplex)[0] = a;
+          (*simplex)[1] = b;
+        }
+      }
+    }
+    const GridPoint& q0 = grid_[(*simplex)[0]];
+    if (q0 == grid_[(*simplex)[1]]) {
+      return false;
+    }
+
+    // The point furthest from that line.
+    const glm::dvec3& p0 = points_[(*simplex)[0]];
+    glm::dvec3 dir = glm::normalize(points_[(*simplex)[1]] - p0);
+    best = -1;
+    for (size_t i = 0; i < points_.size(); ++i) {
+      double d = glm::length(glm::cross(points_[i] - p0, dir));
+      if (d > best) {
+        best = d;
+        (*simplex)[2] = i;
+      }
+    }
+    GridPoint line = Sub(grid_[(*simplex)[1]], q0);
+    auto off_line = [&](int i) { return Cross(line, Sub(grid_[i], q0)) != GridPoint{0, 0, 0}; };
+    if (!off_line((*simplex)[2]) && !FindPoint(off_line, &(*simplex)[2])) {
+      return false;
+    }
+
+    // The point furthest from that plane.
+    glm::dvec3 normal =
+        glm::normalize(glm::cross(points_[(*simplex)[1]] - p0, points_[(*simplex)[2]] - p0));
+    best = -1;
+    for (size_t i = 0; i < points_.size(); ++i) {
+      double d = std::abs(glm::dot(points_[i] - p0, normal));
+      if (d > best) {
+        best = d;
+        (*simplex)[3] = i;
+      }
+    }
+    auto off_plane = [&](int i) {
+      return Orientation(q0, grid_[(*simplex)[1]], grid_[(*simplex)[2]], grid_[i]) != 0;
+    };
+    return off_plane((*simplex)[3]) || FindPoint(off_plane, &(*simplex)[3]);
+  }
+
+  template <typename Predicate>
+  bool FindPoint(const Predicate& predicate, int* found) const {
+    for (size_t i = 0; i < points_.size(); ++i) {
+      if (predicate(i)) {
+        *found = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int AddFace(int a, int b, int c) {
+    HullFace face;
+    face.v = {a, b, c};
+    face.normal = glm::cross(points_[b] - points_[a], points_[c] - points_[a]);
+    double length = glm::length(face.normal);
+    face.normal = length > 0 ? face.normal / length : glm::dvec3(0);
+    face.offset = glm::dot(face.normal, points_[a]);
+    int index = faces_.size();
+    faces_.push_back(std::move(face));
+    edges_[EdgeKey(a, b)] = index;
+    edges_[EdgeKey(b, c)] = index;
+    edges_[EdgeKey(c, a)] = index;
+    return index;
+  }
+
+  void RemoveFace(int index) {
+    HullFace& face = faces_[index];
+    for (int i = 0; i < 3; ++i) {
+      auto it = edges_.find(EdgeKey(face.v[i], face.v[(i + 1) % 3]));
+      if (it != edges_.end() && it->second == index) {
+        edges_.erase(it);
+      }
+    }
+    face.deleted = true;
+  }
+
+  bool AssignOutside(int p, const std::vector<int>& faces) {
+    for (int f : faces) {
+      if (!faces_[f].deleted && IsOutside(faces_[f], p)) {
+        faces_[f].outside.push_back(p);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Points which are not outside of any of faces are dropped, unless they are outside of another
+  // face of the hull, which they can be when they were only listed for one of the faces they are
+  // outside of.
+  void AssignOutside(const std::vector<int>& points, const std::vector<int>& faces) {
+    std::vector<int> all_faces;
+    for (int p : points) {
+      if (AssignOutside(p, faces)) {
+        continue;
+      }
+      if (all_faces.empty()) {
+        for (size_t f = 0; f < faces_.size(); ++f) {
+          all_faces.push_back(f);
+        }
+      }
+      AssignOutside(p, all_faces);
+    }
+  }
+
+  // Adds the furthest point outside of face to the hull.
+  void AddPoint(int face_index) {
+    const HullFace& face = faces_[face_index];
+    int eye = face.outside[0];
+    double best = Distance(face, points_[eye]);
+    for (int p : face.outside) {
+      double d = Distance(face, points_[p]);
+      if (d > best) {
+        best = d;
+        eye = p;
+      }
+    }
+
+    // Faces which can see the eye point form a connected region around face_index.
+    std::vector<int> visible = {face_index};
+    std::vector<bool> is_visible(faces_.size(), false);
+    is_visible[face_index] = true;
+    std::vector<std::array<int, 2>> horizon;
+    for (size_t i = 0; i < visible.size(); ++i) {
+      const HullFace& f = faces_[visible[i]];
+      for (int e = 0; e < 3; ++e) {
+        int a = f.v[e];
+        int b = f.v[(e + 1) % 3];
+        auto it = edges_.find(EdgeKey(b, a));
+        if (it == edges_.end()) {
+          broken_ = true;
+          return;
+        }
+        int neighbor = it->second;
+        if (is_visible[neighbor]) {
+          continue;
+        }
+        if (IsOutside(faces_[neighbor], eye)) {
+          is_visible[neighbor] = true;
+          visible.push_back(neighbor);
+        } else {
+          horizon.push_back({a, b});
+        }
+      }
+    }
+
+    std::vector<int> orphans;
+    for (int f : visible) {
+      for (int p : faces_[f].outside) {
+        if (p != eye) {
+          orphans.push_back(p);
+        }
+      }
+      faces_[f].outside.clear();
+      RemoveFace(f);
+    }
+    std::vector<int> new_faces;
+    for (const auto& edge : horizon) {
+      new_faces.push_back(AddFace(edge[0], edge[1], eye));
+    }
+    AssignOutside(orphans, new_faces);
+  }
+
+  bool Finish(Mesh* hull) {
+    if (broken_) {
+      return false;
+    }
+    Mesh result;
+    std::unordered_map<int, int> remap;
+    for (const HullFace& face : faces_) {
+      if (face.deleted) {
+        continue;
+      }
+      std::array<int, 3> triangle;
+      for (int i = 0; i < 3; ++i) {
+        // Every edge must have exactly one opposite edge for the hull to be closed.
+        if (edges_.find(EdgeKey(face.v[(i + 1) % 3], face.v[i])) == edges_.end()) {
+          return false;
+        }
+        auto inserted = remap.emplace(face.v[i], result.vertices.size());
+        if (inserted.second) {
+          result.vertices.push_back(points_[face.v[i]]);
+        }
+        triangle[i] = inserted.first->second;
+      }
+      result.triangles.push_back(triangle);
+    }
+    *hull = std::move(result);
+    return true;
+  }
+
+  const std::vector<glm::dvec3>& points_;
+  const std::vector<GridPoint>& grid_;
+  std::vector<HullFace> faces_;
+  // Maps each directed edge to the face it belongs to.
+  std::unordered_map<uint64_t, int> edges_;
+  bool broken_ = false;
+};
+
+void AddPoint(const glm::dmat4& m, const glm::dvec3& p, std::vector<glm::dvec3>* points) {
+  points->push_back(glm::dvec3(m * glm::dvec4(p, 1)));
+}
+
+void AddCircle(const glm::dmat4& m,
+               double r,
+               int fragments,
+               double z,
+               std::vector<glm::dvec3>* points) {
+  if (r <= 0) {
+    AddPoint(m, glm::dvec3(0, 0, z), points);
+    return;
+  }
+  for (const glm::dvec2& p : CirclePoints(r, fragments)) {
+    AddPoint(m, glm::dvec3(p, z), points);
+  }
+}
+
+bool CollectHullPoints(const Shape& shape, const glm::dmat4& m, std::vector<glm::dvec3>* points) {
+  const Node* node = shape.node();
+  if (node == nullptr) {
+    return true;
+  }
+  const std::vector<double>& args = node->args;
+  switch (node->type) {
+    case NodeType::CUBE: {
+      glm::dvec3 size(args[0], args[1], args[2]);
+      glm::dvec3 low = args[3] ? -0.5 * size : glm::dvec3(0);
+      for (int i = 0; i < 8; ++i) {
+        AddPoint(m, low + size * glm::dvec3(i & 1, (i >> 1) & 1, (i >> 2) & 1), points);
+      }
+      return true;
+    }
+    case NodeType::SQUARE: {
+      glm::dvec3 size(args[0], args[1], 0);
+      glm::dvec3 low = args[2] ? -0.5 * size : glm::dvec3(0);
+      for (int i = 0; i < 4; ++i) {
+        AddPoint(m, low + size * glm::dvec3(i & 1, (i >> 1) & 1, 0), points);
+      }
+      return true;
+    }
+    case NodeType::CIRCLE:
+      AddCircle(m, args[0], GetFragments(args[0], args[1], args[3], args[2]), 0, points);
+      return true;
+    case NodeType::SPHERE: {
+      double r = args[0];
+      int fragments = GetFragments(r, args[1], args[3], args[2]);
+      int rings = (fragments + 1) / 2;
+      for (int i = 0; i < rings; ++i) {
+        double phi = glm::radians(180.0 * (i + 0.5) / rings);
+        AddCircle(m, r * std::sin(phi), fragments, r * std::cos(phi), points);
+      }
+      return true;
+    }
+    case NodeType::CYLINDER: {
+      double h = args[0];
+      double r1 = args[1];
+      double r2 = args[2];
+      double z1 = args[3] ? -h / 2 : 0;
+      int fragments = GetFragments(std::max(r1, r2), args[4], kUnsetArg, kUnsetArg);
+      AddCircle(m, r1, fragments, z1, points);
+      AddCircle(m, r2, fragments, z1 + h, points);
+      return true;
+    }
+    case NodeType::POLYGON:
+      for (size_t i = 0; i + 1 < args.size(); i += 2) {
+        AddPoint(m, glm::dvec3(args[i], args[i + 1], 0), points);
+      }
+      return true;
+    case NodeType::POLYHEDRON:
+      for (size_t i = 1; i + 2 < args.size(); i += 3) {
+        AddPoint(m, glm::dvec3(args[i], args[i + 1], args[i + 2]), points);
+      }
+      return true;
+    case NodeType::TRANSLATE:
+    case NodeType::ROTATE:
+    case NodeType::ROTATE_AXIS:
+    case NodeType::MIRROR:
+    case NodeType::SCALE:
+    case NodeType::MULTMATRIX:
+      return CollectHullPoints(node->children[0], m * GetNodeMatrix(*node), points);
+    case NodeType::UNION:
+    case NodeType::HULL:
+    case NodeType::COMMENT:
+    case NodeType::COLOR:
+    case NodeType::COLOR_NAME:
+    case NodeType::ALPHA:
+      for (const Shape& child : node->children) {
+        if (!CollectHullPoints(child, m, points)) {
+          return false;
+        }
+      }
+      return true;
+    case NodeType::PROJECTION: {
+      // With cut the result depends on the actual geometry at z = 0.
+      if (args[0]) {
+        return false;
+      }
+      std::vector<glm::dvec3> child_points;
+      if (!CollectHullPoints(node->children[0], glm::dmat4(1.0), &child_points)) {
+        return false;
+      }
+      for (const glm::dvec3& p : child_points) {
+        AddPoint(m, glm::dvec3(p.x, p.y, 0), points);
+      }
+      return true;
+    }
+    case NodeType::LINEAR_EXTRUDE: {
+      double height = args[0];
+      double twist = args[3];
+      double scale = args[5];
+      if (twist != 0) {
+        return false;
+      }
+      std::vector<glm::dvec3> child_points;
+      if (!CollectHullPoints(node->children[0], glm::dmat4(1.0), &child_points)) {
+        return false;
+      }
+      double z1 = args[1] ? -height / 2 : 0;
+      for (const glm::dvec3& p : child_points) {
+        AddPoint(m, glm::dvec3(p.x, p.y, z1), points);
+        AddPoint(m, glm::dvec3(p.x * scale, p.y * scale, z1 + height), points);
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+// Snaps points to a grid of kGridSteps steps either side of the center of their bounds and sets
+// half_size to half the size of those bounds. Returns false if the points have no size.
+bool SnapToGrid(const std::vector<glm::dvec3>& points,
+                double* half_size,
+                std::vector<GridPoint>* grid) {
+  if (points.empty()) {
+    return false;
+  }
+  glm::dvec3 low = points[0];
+  glm::dvec3 high = points[0];
+  for (const glm::dvec3& p : points) {
+    low = glm::min(low, p);
+    high = glm::max(high, p);
+  }
+  glm::dvec3 center = (low + high) / 2.0;
+  *half_size = std::max({high.x - low.x, high.y - low.y, high.z - low.z}) / 2;
+  if (!(*half_size > 0) || !std::isfinite(*half_size)) {
+    return false;
+  }
+  // The grid step is about 1e-8 of the size of the points, so only points which are within that
+  // of each other or of a plane are treated as coincident or coplanar.
+  double scale = kGridSteps / *half_size;
+  grid->clear();
+  grid->reserve(points.size());
+  for (const glm::dvec3& p : points) {
+    glm::dvec3 q = glm::round((p - center) * scale);
+    grid->push_back(
+        {static_cast<int64_t>(q.x), static_cast<int64_t>(q.y), static_cast<int64_t>(q.z)});
+  }
+  return true;
+}
+
+// Computes the convex hull of points with the orientation tests done on the grid of SnapToGrid.
+bool ExactHull(const std::vector<glm::dvec3>& points, double* half_size, Mesh* hull) {
+  std::vector<GridPoint> grid;
+  return points.size() >= 4 && SnapToGrid(points, half_size, &grid) &&
+         QuickHull(points, grid).Run(hull);
+}
+
+// How far p is in front of the furthest face plane of hull, which is below zero if p is inside.
+// Triangles thinner than min_height are skipped: their corners are only coplanar on the grid, so
+// their planes can point anywhere.
+double DistanceOutside(const glm::dvec3& p, const Mesh& hull, double min_height) {
+  double distance = -std::numeric_limits<double>::infinity();
+  for (const auto& t : hull.triangles) {
+    const glm::dvec3& a = hull.vertices[t[0]];
+    const glm::dvec3& b = hull.vertices[t[1]];
+    const glm::dvec3& c = hull.vertices[t[2]];
+    glm::dvec3 normal = glm::cross(b - a, c - a);
+    double length = glm::length(normal);
+    double longest = std::max({glm::length(b - a), glm::length(c - b), glm::length(a - c)});
+    if (length > min_height * longest) {
+      distance = std::max(distance, glm::dot(normal, p - a) / length);
+    }
+  }
+  return distance;
+}
+
+// Returns which vertices of hull stand out by more than tolerance above all of their neighbors,
+// when seen along the sum of the normals of their triangles. The others are on a face or an edge
+// of the hull, up to about tolerance.
+std::vector<bool> FindCorners(const Mesh& hull, double tolerance) {
+  std::vector<glm::dvec3> normals(hull.vertices.size(), glm::dvec3(0));
+  for (const auto& t : hull.triangles) {
+    glm::dvec3 normal = glm::cross(hull.vertices[t[1]] - hull.vertices[t[0]],
+                                   hull.vertices[t[2]] - hull.vertices[t[0]]);
+    for (int v : t) {
+      normals[v] += normal;
+    }
+  }
+  std::vector<double> heights(hull.vertices.size(), std::numeric_limits<double>::infinity());
+  for (const auto& t : hull.triangles) {
+    for (int i = 0; i < 3; ++i) {
+      const glm::dvec3& p = hull.vertices[t[i]];
+      for (int j = 1; j < 3; ++j) {
+        double height = glm::dot(normals[t[i]], p - hull.vertices[t[(i + j) % 3]]);
+        heights[t[i]] = std::min(heights[t[i]], height);
+      }
+    }
+  }
+  std::vector<bool> corners(hull.vertices.size());
+  for (size_t i = 0; i < corners.size(); ++i) {
+    corners[i] = heights[i] > tolerance * glm::length(normals[i]);
+  }
+  return corners;
+}
+
+}  // namespace
+
+bool SpansVolume(const std::vector<glm::dvec3>& points) {
+  double half_size = 0;
+  std::vector<GridPoint> grid;
+  if (!SnapToGrid(points, &half_size, &grid)) {
+    return false;
+  }
+  // Any point other than the first gives a line, any point off it a plane and any point off that a
+  // volume.
+  const GridPoint& q0 = grid[0];
+  auto q1 = std::find_if(grid.begin(), grid.end(), [&](const GridPoint& q) { return q != q0; });
+  if (q1 == grid.end()) {
+    return false;
+  }
+  GridPoint line = Sub(*q1, q0);
+  auto off_line = [&](const GridPoint& q) { return Cross(line, Sub(q, q0)) != GridPoint{0, 0, 0}; };
+  auto q2 = std::find_if(grid.begin(), grid.end(), off_line);
+  if (q2 == grid.end()) {
+    return false;
+  }
+  auto off_plane = [&](const GridPoint& q) { return Orientation(q0, *q1, *q2, q) != 0; };
+  return std::find_if(grid.begin(), grid.end(), off_plane) != grid.end();
+}
+
+bool ConvexHull(const std::vector<glm::dvec3>& points, Mesh* hull) {
+  double half_size = 0;
+  Mesh result;
+  if (!ExactHull(points, &half_size, &result)) {
+    return false;
+  }
+  // Snapping breaks up faces and edges whose points are coplanar or collinear but not in an axis
+  // plane, which keeps vertices that only add thin wedges. Those are dropped, as long as each of
+  // them is within a grid step of the hull of the rest.
+  double tolerance = half_size / kGridSteps;
+  std::vector<bool> is_corner = FindCorners(result, tolerance);
+  std::vector<glm::dvec3> corners;
+  std::vector<glm::dvec3> dropped;
+  for (size_t i = 0; i < result.vertices.size(); ++i) {
+    (is_corner[i] ? corners : dropped).push_back(result.vertices[i]);
+  }
+  Mesh pruned;
+  if (!dropped.empty() && ExactHull(corners, &half_size, &pruned) &&
+      std::all_of(dropped.begin(), dropped.end(), [&](const glm::dvec3& p) {
+        return DistanceOutside(p, pruned, 4 * tolerance) <= tolerance;
+      })) {
+    result = std::move(pruned);
+  }
+  *hull = std::move(result);
+  return true;
+}
+
+std::vector<int> ConvexHull2d(const std::vector<glm::dvec2>& points) {
+  // Andrew's monotone chain.
+  std::vector<int> order(points.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return points[a].x < points[b].x || (points[a].x == points[b].x && points[a].y < points[b].y);
+  });
+  auto turns_left = [&](int a, int b, int c) {
+    glm::dvec2 u = points[b] - points[a];
+    glm::dvec2 v = points[c] - points[a];
+    return u.x * v.y - u.y * v.x > kMinHullArea;
+  };
+  std::vector<int> hull(2 * order.size());
+  size_t k = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    while (k >= 2 && !turns_left(hull[k - 2], hull[k - 1], order[i])) {
+      --k;
+    }
+    hull[k++] = order[i];
+  }
+  for (size_t i = order.size() - 1, lower = k + 1; i > 0; --i) {
+    while (k >= lower && !turns_left(hull[k - 2], hull[k - 1], order[i - 1])) {
+      --k;
+    }
+    hull[k++] = order[i - 1];
+  }
+  if (k < 4) {
+    return {};
+  }
+  // The last point repeats the first.
+  hull.resize(k - 1);
+  return hull;
+}
+
+bool CollectHullPoints(const Shape& shape, std::vector<glm::dvec3>* points) {
+  return CollectHullPoints(shape, glm::dmat4(1.0), points);
+}
+
+Shape EvaluateHull(const std::vector<Shape>& shapes) {
+  std::vector<glm::dvec3> points;
+  for (const Shape& shape : shapes) {
+    if (!CollectHullPoints(shape, &points)) {
+      return Shape();
+    }
+  }
+  Mesh hull;
+  if (!ConvexHull(points, &hull)) {
+    return Shape();
+  }
+  std::vector<Point3d> vertices;
+  vertices.reserve(hull.vertices.size());
+  for (const glm::dvec3& v : hull.vertices) {
+    vertices.push_back({v.x, v.y, v.z});
+  }
+  // OpenSCAD wants faces to be clockwise when seen from outside.
+  std::vector<std::vector<int>> faces;
+  faces.reserve(hull.triangles.size());
+  for (const auto& t : hull.triangles) {
+    faces.push_back({t[0], t[2], t[1]});
+  }
+  return Polyhedron(vertices, faces);
+}
+
+}  // namespace scad
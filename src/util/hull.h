@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "mesh.h"
+#include "scad.h"
+
+namespace scad {
+
+// Whether points span a volume, that is whether they are not all on one plane when snapped to the
+// grid ConvexHull uses.
+bool SpansVolume(const std::vector<glm::dvec3>& points);
+
+// Computes the convex hull of points with quickhull. The orientation tests are exact on the points
+// snapped to a grid of about 1e-8 of their size, so coplanar points never make it fail, and
+// vertices within a grid step of a face or an edge are left out. Returns false if the points do
+// not span a volume, or if quickhull could not close the hull, which should never happen. hull is
+// left untouched then.
+bool ConvexHull(const std::vector<glm::dvec3>& points, Mesh* hull);
+
+// Returns the indices of the points on the 2D convex hull of points, counter clockwise and without
+// collinear points.
+std::vector<int> ConvexHull2d(const std::vector<glm::dvec2>& points);
+
+// Appends points whose convex hull is the convex hull of shape. This works for cubes, polyhedra,
+// cylinders, spheres, 2D primitives and anything built from them with affine transforms, unions,
+// hulls, projections and linear extrusions without twist. Returns false for anything else (for
+// example differences, which can not be described by their vertices).
+bool CollectHullPoints(const Shape& shape, std::vector<glm::dvec3>* points);
+
+// Returns a polyhedron for hull() of shapes, or an empty shape if CollectHullPoints or ConvexHull
+// fail for them.
+Shape EvaluateHull(const std::vector<Shape>& shapes);
+
+}  // namespace scad
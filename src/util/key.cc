@@ -54,7 +54,7 @@ Shape RotateCapEdge(Shape s, SaEdgeType edge_type) {
 
 }  // namespace
 
-Shape MakeSwitch(bool add_side_nub) {
+Shape MakeSwitch(bool add_side_nub, bool preview) {
   std::vector<Shape> shapes;
   Shape top_wall = Cube(kSwitchWidth + kWallWidth * 2, kWallWidth, kSwitchThickness)
                        .Translate(0, kWallWidth / 2 + kSwitchWidth / 2, kSwitchThickness / 2);
@@ -64,11 +64,19 @@ Shape MakeSwitch(bool add_side_nub) {
   shapes.push_back(top_wall.RotateZ(180));
   shapes.push_back(top_wall.RotateZ(270));
 
-  if (add_side_nub) {
+  if (add_side_nub && preview) {
+    // The bounding box of the nub below.
+    double x = kSwitchWidth / 2 + (kWallWidth - 1) / 2;
+    Shape side_nub =
+        Cube(kWallWidth + 1, 2.75, kSwitchThickness).Translate(x, 0, kSwitchThickness / 2);
+    shapes.push_back(side_nub);
+    shapes.push_back(side_nub.RotateZ(180));
+  } else if (add_side_nub) {
+    Shape nub_cylinder = Cylinder(2.75, 1, Resolution("switch_nub", 1, 30));
     Shape side_nub =
         Hull(Cube(kWallWidth, 2.75, kSwitchThickness)
                  .Translate(kWallWidth / 2 + kSwitchWidth / 2, 0, kSwitchThickness / 2),
-             Cylinder(2.75, 1, 30).RotateX(90).Translate(kSwitchWidth / 2, 0, 1));
+             nub_cylinder.RotateX(90).Translate(kSwitchWidth / 2, 0, 1));
     shapes.push_back(side_nub);
     shapes.push_back(side_nub.RotateZ(180));
   }
@@ -146,21 +154,77 @@ Key& Key::SetParent(const TransformList& transforms) {
   return *this;
 }
 
-TransformList Key::GetTransforms() const {
-  TransformList transforms;
-  transforms.Append(local_transforms);
-  transforms.Append(parent_transforms);
-  return transforms;
+bool Key::IsCacheValid() const {
+  return cache_.valid && cache_.local_revision == local_transforms.revision() &&
+         cache_.parent_revision == parent_transforms.revision() &&
+         cache_.extra_width_top == extra_width_top &&
+         cache_.extra_width_bottom == extra_width_bottom &&
+         cache_.extra_width_left == extra_width_left &&
+         cache_.extra_width_right == extra_width_right && cache_.extra_z == extra_z &&
+         cache_.type == type && cache_.disable_switch_z_offset == disable_switch_z_offset;
 }
 
-TransformList Key::GetSwitchTransforms() const {
+const Key::Cache& Key::GetCache() const {
+  if (IsCacheValid()) {
+    return cache_;
+  }
+  Cache& c = cache_;
+  c.local_revision = local_transforms.revision();
+  c.parent_revision = parent_transforms.revision();
+  c.extra_width_top = extra_width_top;
+  c.extra_width_bottom = extra_width_bottom;
+  c.extra_width_left = extra_width_left;
+  c.extra_width_right = extra_width_right;
+  c.extra_z = extra_z;
+  c.type = type;
+  c.disable_switch_z_offset = disable_switch_z_offset;
+
+  c.transforms = TransformList();
+  c.transforms.Append(local_transforms);
+  c.transforms.Append(parent_transforms);
+
   double switch_z_offset = type == KeyType::DSA ? kDsaSwitchZOffset : kSaSwitchZOffset;
   if (disable_switch_z_offset) {
     switch_z_offset = 0;
   }
-  TransformList transforms;
-  transforms.AddTransform().z = -1 * switch_z_offset - extra_z;
-  return transforms.Append(GetTransforms());
+  c.switch_transforms = TransformList();
+  c.switch_transforms.AddTransform().z = -1 * switch_z_offset - extra_z;
+  c.switch_transforms.Append(c.transforms);
+
+  const Transform internal_offsets[4] = {
+      {-1 * kSwitchHorizontalOffset, kSwitchHorizontalOffset, 0},
+      {kSwitchHorizontalOffset, kSwitchHorizontalOffset, 0},
+      {kSwitchHorizontalOffset, -1 * kSwitchHorizontalOffset, 0},
+      {-1 * kSwitchHorizontalOffset, -1 * kSwitchHorizontalOffset, 0},
+  };
+  const Transform offsets[4] = {
+      {-1 * extra_width_left, extra_width_top, 0},
+      {extra_width_right, extra_width_top, 0},
+      {extra_width_right, -1 * extra_width_bottom, 0},
+      {-1 * extra_width_left, -1 * extra_width_bottom, 0},
+  };
+  for (int i = 0; i < 4; ++i) {
+    c.internal_corners[i] = TransformList();
+    c.internal_corners[i].AddTransform(internal_offsets[i]);
+    c.internal_corners[i].Append(c.switch_transforms);
+    c.corners[i] = TransformList();
+    c.corners[i].AddTransform(offsets[i]);
+    c.corners[i].Append(c.internal_corners[i]);
+    c.internal_corners[i].matrix();
+    c.corners[i].matrix();
+  }
+  c.transforms.matrix();
+  c.switch_transforms.matrix();
+  c.valid = true;
+  return c;
+}
+
+TransformList Key::GetTransforms() const {
+  return GetCache().transforms;
+}
+
+TransformList Key::GetSwitchTransforms() const {
+  return GetCache().switch_transforms;
 }
 
 Shape Key::GetInverseSwitch() const {
@@ -183,13 +247,13 @@ Shape Key::GetInverseCap(double custom_vertical_length) const {
 Shape Key::GetSwitch() const {
   std::vector<Shape> shapes;
   if (extra_z > 0) {
-    Shape s = Union(MakeSwitch(false), MakeSwitch(add_side_nub).TranslateZ(extra_z));
+    Shape s = Union(MakeSwitch(false), MakeSwitch(add_side_nub, preview).TranslateZ(extra_z));
     if (extra_z > 4) {
       s += MakeSwitch(false).TranslateZ(4);
     }
     shapes.push_back(GetSwitchTransforms().Apply(s));
   } else {
-    shapes.push_back(GetSwitchTransforms().Apply(MakeSwitch(add_side_nub)));
+    shapes.push_back(GetSwitchTransforms().Apply(MakeSwitch(add_side_nub, preview)));
   }
   if (extra_width_top > 0) {
     shapes.push_back(Hull(GetTopRight().Apply(GetPostConnector()),
@@ -255,42 +319,48 @@ Shape Key::GetCap(bool fill_in_cap_path) const {
 }
 
 TransformList Key::GetTopRight(double offset) const {
+  if (offset == 0) {
+    return GetCache().corners[1];
+  }
   TransformList transforms;
   transforms.AddTransform({extra_width_right + offset, extra_width_top + offset, 0});
   return transforms.Append(GetTopRightInternal());
 }
 
 TransformList Key::GetTopRightInternal() const {
-  TransformList transforms;
-  transforms.AddTransform({kSwitchHorizontalOffset, kSwitchHorizontalOffset, 0});
-  return transforms.Append(GetSwitchTransforms());
+  return GetCache().internal_corners[1];
 }
 
 TransformList Key::GetTopLeft(double offset) const {
+  if (offset == 0) {
+    return GetCache().corners[0];
+  }
   TransformList transforms;
   transforms.AddTransform({-1 * (extra_width_left + offset), extra_width_top + offset, 0});
   return transforms.Append(GetTopLeftInternal());
 }
 
 TransformList Key::GetTopLeftInternal() const {
-  TransformList transforms;
-  transforms.AddTransform({-1 * kSwitchHorizontalOffset, kSwitchHorizontalOffset, 0});
-  return transforms.Append(GetSwitchTransforms());
+  return GetCache().internal_corners[0];
 }
 
 TransformList Key::GetBottomRight(double offset) const {
+  if (offset == 0) {
+    return GetCache().corners[2];
+  }
   TransformList transforms;
   transforms.AddTransform({extra_width_right + offset, -1 * (extra_width_bottom + offset), 0});
   return transforms.Append(GetBottomRightInternal());
 }
 
 TransformList Key::GetBottomRightInternal() const {
-  TransformList transforms;
-  transforms.AddTransform({kSwitchHorizontalOffset, -1 * kSwitchHorizontalOffset, 0});
-  return transforms.Append(GetSwitchTransforms());
+  return GetCache().internal_corners[2];
 }
 
 TransformList Key::GetBottomLeft(double offset) const {
+  if (offset == 0) {
+    return GetCache().corners[3];
+  }
   TransformList transforms;
   transforms.AddTransform(
       {-1 * (extra_width_left + offset), -1 * (extra_width_bottom + offset), 0});
@@ -298,9 +368,7 @@ TransformList Key::GetBottomLeft(double offset) const {
 }
 
 TransformList Key::GetBottomLeftInternal() const {
-  TransformList transforms;
-  transforms.AddTransform({-1 * kSwitchHorizontalOffset, -1 * kSwitchHorizontalOffset, 0});
-  return transforms.Append(GetSwitchTransforms());
+  return GetCache().internal_corners[3];
 }
 
 TransformList Key::GetMiddle() const {
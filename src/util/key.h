@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <functional>
 #include <glm/glm.hpp>
 #include <memory>
@@ -73,6 +75,8 @@ struct Key {
 
   bool add_side_nub = true;
   bool disable_switch_z_offset = false;
+  // Build the switch from boxes only, for quick previews (see MakeSwitch).
+  bool preview = false;
 
   KeyType type = KeyType::DSA;
   SaEdgeType sa_edge_type = SaEdgeType::BOTTOM;
@@ -119,11 +123,41 @@ struct Key {
   std::vector<TransformList> GetCorners(double offset = 0) const;
 
  private:
+  // The same corners are looked up many times while connecting keys, so the transforms which only
+  // depend on the fields above are built once and kept until one of those fields changes. The
+  // matrices of the cached lists are composed up front, so applying them to a point is cheap.
+  struct Cache {
+    bool valid = false;
+    // The state the transforms were built from.
+    uint64_t local_revision = 0;
+    uint64_t parent_revision = 0;
+    double extra_width_top = 0;
+    double extra_width_bottom = 0;
+    double extra_width_left = 0;
+    double extra_width_right = 0;
+    double extra_z = 0;
+    KeyType type = KeyType::DSA;
+    bool disable_switch_z_offset = false;
+
+    TransformList transforms;
+    TransformList switch_transforms;
+    // Clockwise starting at top left, the same as GetCorners.
+    std::array<TransformList, 4> internal_corners;
+    std::array<TransformList, 4> corners;
+  };
+
+  // Not thread safe, a key must not be shared between threads while it is being read. Every
+  // ParallelFor which builds models gives each worker its own KeyData.
+  const Cache& GetCache() const;
+  bool IsCacheValid() const;
+
   // These are the inner corners of the switch plate.
   TransformList GetTopRightInternal() const;
   TransformList GetTopLeftInternal() const;
   TransformList GetBottomRightInternal() const;
   TransformList GetBottomLeftInternal() const;
+
+  mutable Cache cache_;
 };
 
 struct KeyGrid {
@@ -223,6 +257,7 @@ Shape MakeDsaCap();
 Shape MakeSaCap();
 Shape MakeSaEdgeCap(SaEdgeType edge_type = SaEdgeType::BOTTOM);
 Shape MakeSaTallEdgeCap(SaEdgeType edge_type = SaEdgeType::BOTTOM);
-Shape MakeSwitch(bool add_side_nub = true);
+// With preview the side nubs are boxes around the rounded nubs, which are much cheaper to render.
+Shape MakeSwitch(bool add_side_nub = true, bool preview = false);
 
 }  // namespace scad
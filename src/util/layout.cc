@@ -0,0 +1,457 @@
+#include "layout.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "key.h"
+#include "transform.h"
+
+namespace scad {
+namespace {
+
+constexpr double kDefaultSpacing = 18;
+constexpr std::string_view kOriginName = "origin";
+constexpr std::string_view kGap = "-";
+
+using Tokens = std::vector<std::string_view>;
+
+Key MakeRotatedKey(double radius, double degrees) {
+  Key k;
+  k.local_transforms.TranslateZ(-1 * radius).RotateX(degrees).TranslateZ(radius);
+  return k;
+}
+
+// Rotates a key about the x axis, around a center radius below it, until it has traveled the
+// direct distance (not on the arc). Returns false if the distance does not fit on the radius.
+bool GetRotatedKey(double radius, double distance, bool up, Key* key) {
+  if (radius <= 0 || distance > 2 * radius) {
+    return false;
+  }
+  const double rotation_direction = up ? 1.0 : -1.0;
+
+  // The switch top moves along a circle, so the distance is the chord 2r * sin(angle / 2).
+  double radians = 2 * std::asin(distance / (2 * radius));
+  // The key is placed by float transforms, so refine the angle against where it really ends up. The
+  // closed form is already within rounding error, so this converges in a step or two.
+  Key k = MakeRotatedKey(radius, rotation_direction * glm::degrees(radians));
+  for (int i = 0; i < 4; ++i) {
+    double error = glm::length(k.GetTransforms().Apply(kOrigin)) - distance;
+    if (std::abs(error) < 1e-6) {
+      break;
+    }
+    // d/dangle of the chord length.
+    radians -= error / (radius * std::cos(radians / 2));
+    k = MakeRotatedKey(radius, rotation_direction * glm::degrees(radians));
+  }
+  *key = std::move(k);
+  return true;
+}
+
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Splits a line on whitespace. The tokens point into the line.
+void Tokenize(std::string_view line, Tokens* tokens) {
+  tokens->clear();
+  size_t i = 0;
+  while (i < line.size()) {
+    while (i < line.size() && IsSpace(line[i])) {
+      ++i;
+    }
+    size_t start = i;
+    while (i < line.size() && !IsSpace(line[i])) {
+      ++i;
+    }
+    if (i > start) {
+      tokens->push_back(line.substr(start, i - start));
+    }
+  }
+}
+
+// Calls fn with the line number and the tokens of every line which is not blank, stopping when it
+// returns false.
+template <typename Fn>
+bool ForEachLine(std::string_view text, Fn fn) {
+  Tokens tokens;
+  int line_number = 0;
+  while (!text.empty()) {
+    size_t end = text.find('\n');
+    std::string_view line = text.substr(0, end);
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    ++line_number;
+
+    size_t comment = line.find('#');
+    if (comment != std::string_view::npos) {
+      line = line.substr(0, comment);
+    }
+    Tokenize(line, &tokens);
+    if (!tokens.empty() && !fn(line_number, tokens)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ParseNumber(std::string_view s, double* value) {
+  const char* end = s.data() + s.size();
+  std::from_chars_result result = std::from_chars(s.data(), end, *value);
+  return result.ec == std::errc() && result.ptr == end;
+}
+
+// Parses count comma separated numbers.
+bool ParseNumbers(std::string_view s, double* values, int count) {
+  for (int i = 0; i < count; ++i) {
+    size_t comma = i + 1 < count ? s.find(',') : s.size();
+    if (comma == std::string_view::npos || !ParseNumber(s.substr(0, comma), &values[i])) {
+      return false;
+    }
+    s.remove_prefix(std::min(comma + 1, s.size()));
+  }
+  return true;
+}
+
+// Splits name=value. Returns false if there is no =.
+bool SplitAttribute(std::string_view token, std::string_view* name, std::string_view* value) {
+  size_t equals = token.find('=');
+  if (equals == std::string_view::npos) {
+    return false;
+  }
+  *name = token.substr(0, equals);
+  *value = token.substr(equals + 1);
+  return true;
+}
+
+class Parser {
+ public:
+  Parser(const TransformList& origin, Layout* layout, const LayoutOverrides& overrides)
+      : origin_(origin), layout_(layout), overrides_(overrides) {
+  }
+
+  bool Parse(std::string_view text) {
+    // Size the key storage up front so it never moves and the keys can point at each other.
+    size_t key_count = 0;
+    ForEachLine(text, [&](int, const Tokens& tokens) {
+      key_count += tokens[0] == "key";
+      return true;
+    });
+    layout_->keys.reserve(key_count);
+
+    bool ok = ForEachLine(text, [&](int line_number, const Tokens& tokens) {
+      if (!ParseStatement(tokens)) {
+        fprintf(stderr, "Layout line %d: %s\n", line_number, error_.c_str());
+        return false;
+      }
+      return true;
+    });
+    if (!ok) {
+      return false;
+    }
+    for (const auto& override_value : overrides_) {
+      if (used_overrides_.count(override_value.first) == 0) {
+        fprintf(stderr, "Layout has no %s to override\n", override_value.first.c_str());
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  bool Error(const std::string& message) {
+    error_ = message;
+    return false;
+  }
+
+  // Replaces value with the override for name, if there is one.
+  void ApplyOverride(std::string_view name, double* value) {
+    auto it = overrides_.find(name);
+    if (it != overrides_.end()) {
+      *value = it->second;
+      used_overrides_.insert(name);
+    }
+  }
+
+  // Looks up a key which must already have been declared.
+  bool FindKey(std::string_view name, Key** key) {
+    auto it = keys_.find(name);
+    if (it == keys_.end()) {
+      return Error("unknown key " + std::string(name));
+    }
+    *key = it->second;
+    return true;
+  }
+
+  bool ParseStatement(const Tokens& tokens) {
+    std::string_view statement = tokens[0];
+    if (statement == "key") {
+      return ParseKey(tokens);
+    }
+    if (statement == "width") {
+      return ParseWidth(tokens);
+    }
+    if (statement == "row") {
+      return ParseRow(tokens);
+    }
+    if (statement == "thumb") {
+      for (size_t i = 1; i < tokens.size(); ++i) {
+        Key* key;
+        if (!FindKey(tokens[i], &key)) {
+          return false;
+        }
+        layout_->thumb_keys.push_back(key);
+      }
+      return true;
+    }
+    if (statement == "spacing") {
+      if (tokens.size() != 2 || !ParseNumber(tokens[1], &spacing_)) {
+        return Error("expected spacing <mm>");
+      }
+      ApplyOverride("spacing", &spacing_);
+      return true;
+    }
+    if (statement == "radius") {
+      double radius;
+      if (tokens.size() != 3 || !ParseNumber(tokens[2], &radius)) {
+        return Error("expected radius <name> <mm>");
+      }
+      ApplyOverride(tokens[1], &radius);
+      radii_[tokens[1]] = radius;
+      return true;
+    }
+    return Error("unknown statement " + std::string(statement));
+  }
+
+  // Parses <mm>, <name>, <name>+<mm> or <name>-<mm>. Named radii have their overrides applied
+  // already, so an offset from one follows it. Names may contain + and - themselves, so a name is
+  // looked up whole first, and otherwise split at the sign whose rest is a plain number.
+  bool ParseRadius(std::string_view value, double* radius) {
+    if (ParseNumber(value, radius)) {
+      return true;
+    }
+    auto it = radii_.find(value);
+    if (it != radii_.end()) {
+      *radius = it->second;
+      return true;
+    }
+    std::string_view unknown = value;
+    bool bad_offset = false;
+    for (size_t sign = value.find_first_of("+-", 1); sign != std::string_view::npos;
+         sign = value.find_first_of("+-", sign + 1)) {
+      std::string_view name = value.substr(0, sign);
+      std::string_view offset_value = value.substr(sign + 1);
+      double offset = 0;
+      bool is_offset = !offset_value.empty() && offset_value[0] != '-' &&
+                       ParseNumber(offset_value, &offset);
+      it = radii_.find(name);
+      if (it != radii_.end() && is_offset) {
+        *radius = it->second + (value[sign] == '-' ? -offset : offset);
+        return true;
+      }
+      bad_offset = bad_offset || it != radii_.end();
+      if (is_offset && unknown == value) {
+        unknown = name;
+      }
+    }
+    if (bad_offset) {
+      return Error("expected <name>+<mm> or <name>-<mm> instead of radius=" + std::string(value));
+    }
+    return Error("unknown radius " + std::string(unknown));
+  }
+
+  bool ParseKey(const Tokens& tokens) {
+    if (tokens.size() < 2) {
+      return Error("expected a key name");
+    }
+    std::string_view name = tokens[1];
+    if (name == kOriginName || name == kGap || keys_.count(name) > 0) {
+      return Error("key name " + std::string(name) + " is already used");
+    }
+
+    std::string_view parent_name;
+    std::string_view radius_value;
+    double position[3];
+    double rotation[3];
+    bool has_position = false;
+    bool has_rotation = false;
+    int direction = 0;
+    for (size_t i = 2; i < tokens.size(); ++i) {
+      std::string_view attribute;
+      std::string_view value;
+      if (tokens[i] == "up" || tokens[i] == "down") {
+        direction = tokens[i] == "up" ? 1 : -1;
+      } else if (!SplitAttribute(tokens[i], &attribute, &value)) {
+        return Error("unexpected " + std::string(tokens[i]));
+      } else if (attribute == "parent") {
+        parent_name = value;
+      } else if (attribute == "radius") {
+        radius_value = value;
+      } else if (attribute == "position") {
+        if (!ParseNumbers(value, position, 3)) {
+          return Error("expected position=x,y,z");
+        }
+        has_position = true;
+      } else if (attribute == "rotation") {
+        if (!ParseNumbers(value, rotation, 3)) {
+          return Error("expected rotation=rx,ry,rz");
+        }
+        has_rotation = true;
+      } else {
+        return Error("unknown key attribute " + std::string(attribute));
+      }
+    }
+
+    if (parent_name.empty()) {
+      return Error("key " + std::string(name) + " has no parent");
+    }
+    Key* parent = nullptr;
+    if (parent_name != kOriginName && !FindKey(parent_name, &parent)) {
+      return false;
+    }
+
+    Key key;
+    if (!radius_value.empty() || direction != 0) {
+      if (radius_value.empty() || direction == 0) {
+        return Error("a key on a radius needs both radius= and up or down");
+      }
+      if (has_position || has_rotation) {
+        return Error("a key on a radius can not also have a position or rotation");
+      }
+      double radius;
+      if (!ParseRadius(radius_value, &radius)) {
+        return false;
+      }
+      if (!GetRotatedKey(radius, spacing_, direction > 0, &key)) {
+        return Error("keys can not be placed on a radius of " + std::string(radius_value));
+      }
+    }
+
+    key.name = std::string(name);
+    if (parent) {
+      key.SetParent(*parent);
+    } else {
+      key.SetParent(origin_);
+    }
+    if (has_position) {
+      key.SetPosition(position[0], position[1], position[2]);
+    }
+    if (has_rotation) {
+      key.t().rx = rotation[0];
+      key.t().ry = rotation[1];
+      key.t().rz = rotation[2];
+    }
+    layout_->keys.push_back(std::move(key));
+    keys_[name] = &layout_->keys.back();
+    return true;
+  }
+
+  bool ParseWidth(const Tokens& tokens) {
+    Key* key;
+    if (tokens.size() < 2 || !FindKey(tokens[1], &key)) {
+      return Error("expected width <key> side=mm...");
+    }
+    for (size_t i = 2; i < tokens.size(); ++i) {
+      std::string_view side;
+      std::string_view value;
+      double* width = nullptr;
+      if (SplitAttribute(tokens[i], &side, &value)) {
+        if (side == "top") {
+          width = &key->extra_width_top;
+        } else if (side == "bottom") {
+          width = &key->extra_width_bottom;
+        } else if (side == "left") {
+          width = &key->extra_width_left;
+        } else if (side == "right") {
+          width = &key->extra_width_right;
+        }
+      }
+      if (!width || !ParseNumber(value, width)) {
+        return Error("expected top, bottom, left or right=mm instead of " +
+                     std::string(tokens[i]));
+      }
+    }
+    return true;
+  }
+
+  bool ParseRow(const Tokens& tokens) {
+    std::vector<Key*> row;
+    for (size_t i = 1; i < tokens.size(); ++i) {
+      Key* key = nullptr;
+      if (tokens[i] != kGap && !FindKey(tokens[i], &key)) {
+        return false;
+      }
+      row.push_back(key);
+    }
+    if (row.empty()) {
+      return Error("empty row");
+    }
+    if (!layout_->grid.empty() && layout_->grid[0].size() != row.size()) {
+      return Error("every row needs the same number of keys, use - for gaps");
+    }
+    layout_->grid.push_back(std::move(row));
+    return true;
+  }
+
+  const TransformList& origin_;
+  Layout* layout_;
+  const LayoutOverrides& overrides_;
+  std::unordered_set<std::string_view> used_overrides_;
+  // Both point into the text being parsed.
+  std::unordered_map<std::string_view, Key*> keys_;
+  std::unordered_map<std::string_view, double> radii_;
+  double spacing_ = kDefaultSpacing;
+  std::string error_;
+};
+
+}  // namespace
+
+Key* Layout::FindKey(std::string_view name) {
+  for (Key& key : keys) {
+    if (key.name == name) {
+      return &key;
+    }
+  }
+  return nullptr;
+}
+
+bool ParseLayout(std::string_view text,
+                 const TransformList& origin,
+                 Layout* layout,
+                 const LayoutOverrides& overrides) {
+  Layout result;
+  if (!Parser(origin, &result, overrides).Parse(text)) {
+    return false;
+  }
+  *layout = std::move(result);
+  return true;
+}
+
+bool LoadLayout(const std::string& file_name,
+                const TransformList& origin,
+                Layout* layout,
+                const LayoutOverrides& overrides) {
+  std::ifstream in(file_name, std::ios::binary);
+  if (!in) {
+    fprintf(stderr, "Could not open layout %s\n", file_name.c_str());
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  std::string text = buffer.str();
+  if (!ParseLayout(text, origin, layout, overrides)) {
+    fprintf(stderr, "Could not load layout %s\n", file_name.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace scad
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "key.h"
+#include "transform.h"
+
+namespace scad {
+
+// Keys placed by a layout file, so the layout can change without rebuilding. A layout has one
+// statement per line, # starts a comment and lengths are in mm and angles in degrees:
+//
+//   spacing <mm>
+//     The direct distance between switch tops of keys placed on a radius. Defaults to 18.
+//   radius <name> <mm>
+//     Names a column radius.
+//   key <name> parent=<key> [position=x,y,z] [rotation=rx,ry,rz]
+//     Places a key relative to its parent, which must be declared earlier. The parent "origin" is
+//     the origin passed to the loader.
+//   key <name> parent=<key> radius=<radius> up|down
+//     Places a key by rotating it about the x axis, around a center the radius below its parent,
+//     until it is spacing away from its parent. The radius is in mm, a named radius, or a named
+//     radius plus or minus mm such as d_column+15. Names may contain + and -, a radius which is
+//     named exactly like the value is used as it is.
+//   width <key> [top=mm] [bottom=mm] [left=mm] [right=mm]
+//     Sets the extra widths of a key (see Key::extra_width_top).
+//   row <key or -> ...
+//     Adds the next row of the key grid, - marks a gap.
+//   thumb <key> ...
+//     Adds keys to the thumb cluster.
+class Layout {
+ public:
+  Layout() = default;
+  // The grid and the thumb keys point into keys, so a layout can be moved but not copied.
+  Layout(const Layout&) = delete;
+  Layout& operator=(const Layout&) = delete;
+  Layout(Layout&&) = default;
+  Layout& operator=(Layout&&) = default;
+
+  // Every key, in the order they were declared.
+  std::vector<Key> keys;
+  std::vector<std::vector<Key*>> grid;
+  std::vector<Key*> thumb_keys;
+
+  // Returns nullptr if there is no key with the name.
+  Key* FindKey(std::string_view name);
+};
+
+// Values which replace the ones in a layout, keyed by "spacing" or the name of a radius. Used to
+// try variants of a layout without editing it.
+using LayoutOverrides = std::map<std::string, double, std::less<>>;
+
+// Parses the text of a layout. Tokens are read in place and the keys are built into storage sized
+// up front, so a layout loads in about the time it takes to read it. Returns false and prints the
+// reason on the first error, including overrides the layout has no use for.
+bool ParseLayout(std::string_view text,
+                 const TransformList& origin,
+                 Layout* layout,
+                 const LayoutOverrides& overrides = {});
+bool LoadLayout(const std::string& file_name,
+                const TransformList& origin,
+                Layout* layout,
+                const LayoutOverrides& overrides = {});
+
+}  // namespace scad
@@ -0,0 +1,75 @@
+#include "mesh.h"
+
+// Windows!
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "scad.h"
+
+namespace scad {
+namespace {
+
+// OpenSCAD's defaults for the special variables.
+const double kDefaultFs = 2;
+const double kDefaultFa = 12;
+const double kMinFragments = 5;
+
+}  // namespace
+
+Mesh MirrorMesh(const Mesh& mesh, const glm::dvec3& normal) {
+  glm::dvec3 n = glm::normalize(normal);
+  Mesh mirrored;
+  mirrored.vertices.reserve(mesh.vertices.size());
+  for (const glm::dvec3& v : mesh.vertices) {
+    mirrored.vertices.push_back(v - 2 * glm::dot(v, n) * n);
+  }
+  mirrored.triangles.reserve(mesh.triangles.size());
+  for (const std::array<int, 3>& t : mesh.triangles) {
+    mirrored.triangles.push_back({t[0], t[2], t[1]});
+  }
+  return mirrored;
+}
+
+int GetFragments(double r, double fn, double fs, double fa) {
+  if (r < 1e-9) {
+    return 3;
+  }
+  if (IsSet(fn) && fn > 0) {
+    return std::max(3, (int)fn);
+  }
+  fs = IsSet(fs) ? fs : kDefaultFs;
+  fa = IsSet(fa) ? fa : kDefaultFa;
+  return (int)std::ceil(std::max(std::min(360.0 / fa, r * 2 * M_PI / fs), kMinFragments));
+}
+
+int GetNodeFragments(const Node& node) {
+  const std::vector<double>& args = node.args;
+  switch (node.type) {
+    case NodeType::SPHERE:
+    case NodeType::CIRCLE:
+      return GetFragments(args[0], args[1], args[3], args[2]);
+    case NodeType::CYLINDER:
+      return GetFragments(std::max(args[1], args[2]), args[4], kUnsetArg, kUnsetArg);
+    default:
+      return 0;
+  }
+}
+
+std::vector<glm::dvec2> CirclePoints(double r, int fragments) {
+  std::vector<glm::dvec2> points;
+  points.reserve(fragments);
+  for (int i = 0; i < fragments; ++i) {
+    double phi = glm::radians(360.0 * i / fragments);
+    points.emplace_back(r * std::cos(phi), r * std::sin(phi));
+  }
+  return points;
+}
+
+}  // namespace scad
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <array>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "scad.h"
+
+namespace scad {
+
+// A triangle mesh. Triangles are counter clockwise when seen from outside.
+struct Mesh {
+  std::vector<glm::dvec3> vertices;
+  std::vector<std::array<int, 3>> triangles;
+};
+
+// Reflects mesh in the plane through the origin with the given normal, like OpenSCAD's mirror. The
+// winding of the triangles is reversed so they still face out.
+Mesh MirrorMesh(const Mesh& mesh, const glm::dvec3& normal);
+
+// The number of segments OpenSCAD uses for a circle of radius r, matching its $fn, $fs and $fa
+// rules. Pass a NaN (see IsSet) for special variables which are not set.
+int GetFragments(double r, double fn, double fs, double fa);
+
+// The number of segments of a sphere, circle or cylinder node (see GetFragments), or zero for any
+// other node.
+int GetNodeFragments(const Node& node);
+
+// Points on a circle the same way OpenSCAD generates them, starting on the x axis and going
+// counter clockwise.
+std::vector<glm::dvec2> CirclePoints(double r, int fragments);
+
+}  // namespace scad
@@ -0,0 +1,289 @@
+#include "optimize.h"
+
+#include <functional>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "hull.h"
+#include "mesh.h"
+#include "scad.h"
+#include "transform.h"
+
+namespace scad {
+namespace {
+
+using ShapeMemo = std::unordered_map<const Node*, Shape>;
+
+Shape FoldChildren(const Node& node, const std::vector<Shape>& children) {
+  Node copy = node;
+  copy.children = children;
+  return Shape::Create(std::move(copy));
+}
+
+// Rebuilds the graph bottom up. fn is called once per distinct node with the already rewritten
+// children and returns the replacement for the node.
+Shape RewriteBottomUp(
+    const Shape& shape,
+    const std::function<Shape(const Shape& shape, const std::vector<Shape>& children)>& fn,
+    ShapeMemo* memo) {
+  const Node* node = shape.node();
+  if (node == nullptr) {
+    return shape;
+  }
+  auto it = memo->find(node);
+  if (it != memo->end()) {
+    return it->second;
+  }
+  std::vector<Shape> children;
+  children.reserve(node->children.size());
+  for (const Shape& child : node->children) {
+    children.push_back(RewriteBottomUp(child, fn, memo));
+  }
+  Shape result = fn(shape, children);
+  (*memo)[node] = result;
+  return result;
+}
+
+// Returns shape with its children replaced, reusing the node when nothing changed.
+Shape WithChildren(const Shape& shape, const std::vector<Shape>& children) {
+  return children == shape.node()->children ? shape : FoldChildren(*shape.node(), children);
+}
+
+bool IsIdentity(const glm::dmat4& m) {
+  return m == glm::dmat4(1.0);
+}
+
+Shape FoldTransforms(const Shape& shape, ShapeMemo* memo) {
+  const Node* node = shape.node();
+  if (node == nullptr) {
+    return shape;
+  }
+  auto it = memo->find(node);
+  if (it != memo->end()) {
+    return it->second;
+  }
+
+  Shape result;
+  if (IsAffineTransform(node->type) && node->children.size() == 1) {
+    glm::dmat4 matrix = GetNodeMatrix(*node);
+    int chain_length = 1;
+    const Shape* inner = &node->children[0];
+    while (!inner->empty() && IsAffineTransform(inner->node()->type) &&
+           inner->node()->children.size() == 1) {
+      matrix = matrix * GetNodeMatrix(*inner->node());
+      ++chain_length;
+      inner = &inner->node()->children[0];
+    }
+    Shape folded_child = FoldTransforms(*inner, memo);
+    if (IsIdentity(matrix)) {
+      result = folded_child;
+    } else if (chain_length == 1) {
+      result = FoldChildren(*node, {folded_child});
+    } else {
+      result = MultMatrix(matrix, folded_child);
+    }
+  } else {
+    std::vector<Shape> children;
+    children.reserve(node->children.size());
+    for (const Shape& child : node->children) {
+      children.push_back(FoldTransforms(child, memo));
+    }
+    result = WithChildren(shape, children);
+  }
+  (*memo)[node] = result;
+  return result;
+}
+
+bool IsBoolean(NodeType type) {
+  return type == NodeType::UNION || type == NodeType::INTERSECTION ||
+         type == NodeType::DIFFERENCE;
+}
+
+bool IsSingleTransform(const Shape& shape) {
+  return IsAffineTransform(shape.node()->type) && shape.node()->children.size() == 1;
+}
+
+class BooleanNormalizer {
+ public:
+  explicit BooleanNormalizer(const Shape& shape) {
+    for (const Node* node : FindSharedNodes(shape)) {
+      shared_.insert(node);
+    }
+  }
+
+  Shape Normalize(const Shape& shape) {
+    return RewriteBottomUp(
+        shape,
+        [this](const Shape& shape, const std::vector<Shape>& children) {
+          NodeType type = shape.node()->type;
+          Shape result = IsBoolean(type) ? Build(type, children) : WithChildren(shape, children);
+          // The rewritten children are all that is seen when merging, so remember which of them
+          // stand for a shared node.
+          if (!result.empty() && shared_.count(shape.node()) > 0) {
+            shared_results_.insert(result.node());
+          }
+          return result;
+        },
+        &memo_);
+  }
+
+ private:
+  // Builds a boolean of type out of children which are already normalized.
+  Shape Build(NodeType type, const std::vector<Shape>& children) {
+    std::vector<Shape> flat;
+    for (size_t i = 0; i < children.size(); ++i) {
+      const Shape& child = children[i];
+      if (child.empty()) {
+        if (type == NodeType::DIFFERENCE && i == 0) {
+          return Shape();
+        }
+        continue;
+      }
+      NodeType child_type = child.node()->type;
+      bool merge = false;
+      if (shared_results_.count(child.node()) == 0) {
+        if (type != NodeType::DIFFERENCE) {
+          merge = child_type == type;
+        } else if (i == 0) {
+          merge = child_type == NodeType::DIFFERENCE;
+        } else {
+          merge = child_type == NodeType::UNION;
+        }
+      }
+      if (merge) {
+        const std::vector<Shape>& grandchildren = child.node()->children;
+        flat.insert(flat.end(), grandchildren.begin(), grandchildren.end());
+      } else {
+        flat.push_back(child);
+      }
+    }
+
+    if (flat.empty()) {
+      return Shape();
+    }
+    if (flat.size() == 1) {
+      return flat[0];
+    }
+    // Only sunk when every child has the transform. Grouping some of the children of a union under
+    // it would need another union below the transform, which makes the tree deeper again.
+    bool same_transform = true;
+    for (const Shape& child : flat) {
+      same_transform = same_transform && IsSingleTransform(child) &&
+                       child.node()->type == flat[0].node()->type &&
+                       child.node()->args == flat[0].node()->args;
+    }
+    if (same_transform) {
+      std::vector<Shape> inner;
+      for (const Shape& child : flat) {
+        inner.push_back(child.node()->children[0]);
+      }
+      return FoldChildren(*flat[0].node(), {Build(type, inner)});
+    }
+    return Shape::Composite(type, {}, flat);
+  }
+
+  std::unordered_set<const Node*> shared_;
+  std::unordered_set<const Node*> shared_results_;
+  ShapeMemo memo_;
+};
+
+// Rewrites difference(union(p1, p2, ...), n1, n2, ...) into a union where each positive only
+// subtracts the negatives whose bounds intersect its own. Giving each positive its own difference
+// keeps every difference small, rather than sharing one among the positives a negative touches,
+// which would need a union under it. The positive union is only split up when it has no other
+// parents, otherwise it would be evaluated once more for each.
+Shape RestrictDifference(const std::vector<Shape>& children, bool split_positive) {
+  const Shape& positive = children[0];
+  std::vector<Shape> positives = {positive};
+  if (split_positive && positive.node()->type == NodeType::UNION) {
+    positives = positive.node()->children;
+  }
+  std::vector<Shape> results;
+  for (const Shape& p : positives) {
+    std::vector<Shape> difference = {p};
+    for (size_t i = 1; i < children.size(); ++i) {
+      if (!children[i].empty() && children[i].bounds().Intersects(p.bounds())) {
+        difference.push_back(children[i]);
+      }
+    }
+    results.push_back(difference.size() == 1 ? p : DifferenceAll(difference));
+  }
+  return results.size() == 1 ? results[0] : UnionAll(results);
+}
+
+}  // namespace
+
+Shape EvaluateHulls(const Shape& shape) {
+  ShapeMemo memo;
+  return RewriteBottomUp(
+      shape,
+      [](const Shape& shape, const std::vector<Shape>& children) {
+        if (shape.node()->type == NodeType::HULL) {
+          Shape hull = EvaluateHull(children);
+          if (!hull.empty()) {
+            return hull;
+          }
+        }
+        return WithChildren(shape, children);
+      },
+      &memo);
+}
+
+Shape FoldTransforms(const Shape& shape) {
+  ShapeMemo memo;
+  return FoldTransforms(shape, &memo);
+}
+
+Shape NormalizeBooleans(const Shape& shape) {
+  BooleanNormalizer normalizer(shape);
+  return normalizer.Normalize(shape);
+}
+
+Shape RestrictDifferences(const Shape& shape) {
+  std::unordered_set<const Node*> shared;
+  for (const Node* node : FindSharedNodes(shape)) {
+    shared.insert(node);
+  }
+  ShapeMemo memo;
+  return RewriteBottomUp(
+      shape,
+      [&shared](const Shape& shape, const std::vector<Shape>& children) {
+        const Node& node = *shape.node();
+        if (node.type != NodeType::DIFFERENCE || children.empty() || children[0].empty()) {
+          return WithChildren(shape, children);
+        }
+        return RestrictDifference(children, shared.count(node.children[0].node()) == 0);
+      },
+      &memo);
+}
+
+Shape LimitFragments(const Shape& shape, int max_fragments) {
+  ShapeMemo memo;
+  return RewriteBottomUp(
+      shape,
+      [max_fragments](const Shape& shape, const std::vector<Shape>& children) {
+        const Node& node = *shape.node();
+        if (GetNodeFragments(node) <= max_fragments) {
+          return WithChildren(shape, children);
+        }
+        Node copy = node;
+        copy.args[node.type == NodeType::CYLINDER ? 4 : 1] = max_fragments;
+        return Shape::Create(std::move(copy));
+      },
+      &memo);
+}
+
+Shape Optimize(const Shape& shape) {
+  return OptimizeForMesh(EvaluateHulls(shape));
+}
+
+Shape OptimizeForMesh(const Shape& shape) {
+  // Restricting the differences leaves unions inside unions, which the second NormalizeBooleans
+  // merges again.
+  Shape normalized = NormalizeBooleans(shape);
+  return FoldTransforms(NormalizeBooleans(RestrictDifferences(normalized)));
+}
+
+}  // namespace scad
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "scad.h"
+
+namespace scad {
+
+// Passes which rewrite a shape graph into an equivalent one that is cheaper for OpenSCAD to parse
+// and render. Every pass keeps shared subtrees shared.
+
+// Replaces every hull() whose children can be described by their vertices (see CollectHullPoints)
+// with a polyhedron of the convex hull computed in process, so OpenSCAD never has to hull them.
+Shape SCAD_WARN_UNUSED_RESULT EvaluateHulls(const Shape& shape);
+
+// Replaces every chain of consecutive affine transforms (translate, rotate, mirror, scale and
+// multmatrix) with a single multmatrix. Chains which compose to the identity are removed.
+Shape SCAD_WARN_UNUSED_RESULT FoldTransforms(const Shape& shape);
+
+// Rewrites unions, intersections and differences into wide, shallow trees:
+//  - Empty children are dropped, booleans with a single child are replaced by the child and
+//    booleans left without children become empty.
+//  - A union or intersection child of the same operation is merged into its parent, as is the first
+//    child of a difference which is itself a difference, and a union subtracted by a difference.
+//  - A transform which every child has is moved above the boolean, leaving one copy of it.
+// Subtrees with more than one parent are not merged into their parents, so OpenSCAD still only
+// evaluates them once.
+Shape SCAD_WARN_UNUSED_RESULT NormalizeBooleans(const Shape& shape);
+
+// Splits a difference whose first child is a union into a union of smaller differences: each
+// child of the positive union only subtracts the negatives whose bounds intersect its own. Children
+// which no negative touches are left as they are, and negatives which touch nothing are dropped.
+// Works best on normalized shapes, where the positives and negatives are flat lists.
+Shape SCAD_WARN_UNUSED_RESULT RestrictDifferences(const Shape& shape);
+
+// Lowers $fn on every sphere, circle and cylinder which would otherwise be drawn with more than
+// max_fragments segments. This changes the geometry, so it is not part of Optimize. Used for quick
+// previews.
+Shape SCAD_WARN_UNUSED_RESULT LimitFragments(const Shape& shape, int max_fragments);
+
+// Runs EvaluateHulls, NormalizeBooleans, RestrictDifferences, NormalizeBooleans again and
+// FoldTransforms. This is what should be called before writing a shape.
+Shape SCAD_WARN_UNUSED_RESULT Optimize(const Shape& shape);
+
+// Runs the passes of Optimize except EvaluateHulls. This is what should be called before
+// EvaluateMesh, which builds hulls as convex solids. Those clip more cleanly than the triangles of
+// a polyhedron, which can have slivers where points are almost coplanar.
+Shape SCAD_WARN_UNUSED_RESULT OptimizeForMesh(const Shape& shape);
+
+}  // namespace scad
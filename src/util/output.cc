@@ -0,0 +1,307 @@
+#include "output.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "evaluate.h"
+#include "mesh.h"
+#include "optimize.h"
+#include "parallel.h"
+#include "scad.h"
+#include "scad_writer.h"
+#include "stl.h"
+
+namespace scad {
+namespace {
+
+namespace fs = std::filesystem;
+
+// Bump this whenever a change to the optimizer, the writers or the mesh evaluator changes the file
+// generated for the same shape, so files from older versions are not reused.
+const uint64_t kOutputCacheVersion = 5;
+const char kManifestName[] = "manifest";
+
+// FNV-1a over the bytes of value.
+uint64_t HashValue(uint64_t hash, uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    hash ^= (value >> (i * 8)) & 0xff;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+std::string KeyToString(uint64_t key) {
+  char buffer[17];
+  snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(key));
+  return buffer;
+}
+
+const char* GetExtension(OutputFormat format) {
+  switch (format) {
+    case OutputFormat::SCAD:
+      return ".scad";
+    case OutputFormat::STL:
+    case OutputFormat::OPENSCAD_STL:
+      return ".stl";
+  }
+  return "";
+}
+
+long long GetFileSize(const std::string& path) {
+  std::error_code error;
+  uintmax_t size = fs::file_size(path, error);
+  return error ? -1 : static_cast<long long>(size);
+}
+
+// Quotes s as a single argument for the shell.
+std::string ShellQuote(const std::string& s) {
+  std::string quoted = "'";
+  for (char c : s) {
+    quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+  }
+  return quoted + "'";
+}
+
+// Writes the scad file of shape next to path, so OpenSCAD resolves imports the same way as for the
+// scad files, and renders it into path. Returns the size of the STL file or -1.
+long long RenderWithOpenScad(const Shape& shape, const std::string& path) {
+  std::string scad_file = path + ".scad";
+  long long bytes = -1;
+  if (WriteScadFile(shape, scad_file) >= 0) {
+    std::string command = "openscad --quiet -o " + ShellQuote(path) + " " + ShellQuote(scad_file);
+    if (std::system(command.c_str()) == 0) {
+      bytes = GetFileSize(path);
+    } else {
+      fprintf(stderr, "OpenSCAD could not render %s\n", path.c_str());
+    }
+  }
+  std::error_code error;
+  fs::remove(scad_file, error);
+  return bytes;
+}
+
+// The time the file was last modified, in the ticks of the filesystem clock, or -1 if it does not
+// exist.
+long long GetModifiedTime(const std::string& path) {
+  std::error_code error;
+  fs::file_time_type time = fs::last_write_time(path, error);
+  return error ? -1 : static_cast<long long>(time.time_since_epoch().count());
+}
+
+// The file an import of file_name in job reads. EvaluateMesh opens it as it is, and OpenSCAD
+// relative to the scad file, which RenderWithOpenScad writes next to the output.
+std::string GetImportPath(const OutputJob& job, const std::string& file_name) {
+  if (job.format != OutputFormat::OPENSCAD_STL || fs::path(file_name).is_absolute()) {
+    return file_name;
+  }
+  return (fs::path(job.path).parent_path() / file_name).string();
+}
+
+using ManifestEntry = OutputCache::ManifestEntry;
+
+// The manifest records an entry for each file by absolute path, one
+// "<key> <modified time> <path>" per line. Lines in any other format, like the "<key> <path>" of
+// older versions, are skipped, so those files are copied from the cache once more.
+std::map<std::string, ManifestEntry> ReadManifest(const std::string& file_name) {
+  std::map<std::string, ManifestEntry> manifest;
+  std::ifstream in(file_name);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    ManifestEntry entry;
+    std::string path;
+    if (fields >> key >> entry.modified_time && std::getline(fields >> std::ws, path) &&
+        !path.empty()) {
+      entry.key = std::strtoull(key.c_str(), nullptr, 16);
+      manifest[path] = entry;
+    }
+  }
+  return manifest;
+}
+
+void WriteManifest(const std::map<std::string, ManifestEntry>& manifest,
+                   const std::string& file_name) {
+  std::string temp_file = file_name + ".tmp";
+  {
+    std::ofstream out(temp_file);
+    for (const auto& entry : manifest) {
+      out << KeyToString(entry.second.key) << " " << entry.second.modified_time << " "
+          << entry.first << "\n";
+    }
+  }
+  std::error_code error;
+  fs::rename(temp_file, file_name, error);
+  if (error) {
+    fprintf(stderr, "Could not write file %s\n", file_name.c_str());
+  }
+}
+
+OutputResult WriteCachedOutput(const OutputJob& job,
+                               uint64_t key,
+                               const std::string& cache_directory,
+                               const std::map<std::string, ManifestEntry>& manifest) {
+  auto start = std::chrono::steady_clock::now();
+  std::string cache_file = cache_directory + "/" + KeyToString(key) + GetExtension(job.format);
+  long long cached_bytes = GetFileSize(cache_file);
+  if (cached_bytes < 0) {
+    OutputResult result = WriteOutput(job);
+    if (result.ok) {
+      // Copied under a unique name and then renamed, so jobs with the same key never see a partial
+      // file.
+      static std::atomic<int> next_temp_file(0);
+      std::string temp_file = cache_file + ".tmp" + std::to_string(next_temp_file++);
+      std::error_code error;
+      fs::copy_file(job.path, temp_file, fs::copy_options::overwrite_existing, error);
+      if (!error) {
+        fs::rename(temp_file, cache_file, error);
+      }
+      if (error) {
+        fs::remove(temp_file, error);
+        fprintf(stderr, "Could not add %s to the output cache\n", job.path.c_str());
+      }
+    }
+    return result;
+  }
+
+  OutputResult result;
+  result.path = job.path;
+  result.bytes = cached_bytes;
+  auto it = manifest.find(fs::absolute(job.path).string());
+  if (it != manifest.end() && it->second.key == key &&
+      it->second.modified_time == GetModifiedTime(job.path) &&
+      GetFileSize(job.path) == cached_bytes) {
+    result.ok = true;
+    result.source = OutputSource::UP_TO_DATE;
+  } else {
+    std::error_code error;
+    fs::copy_file(cache_file, job.path, fs::copy_options::overwrite_existing, error);
+    result.ok = !error;
+    result.source = OutputSource::CACHED;
+    if (error) {
+      fprintf(stderr, "Could not write file %s\n", job.path.c_str());
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  result.seconds = elapsed.count();
+  return result;
+}
+
+}  // namespace
+
+OutputResult WriteOutput(const OutputJob& job) {
+  auto start = std::chrono::steady_clock::now();
+  OutputResult result;
+  result.path = job.path;
+
+  switch (job.format) {
+    case OutputFormat::SCAD:
+      result.bytes = WriteScadFile(job.optimize ? Optimize(job.shape) : job.shape, job.path);
+      result.ok = result.bytes >= 0;
+      break;
+    case OutputFormat::STL: {
+      Mesh mesh;
+      if (EvaluateMesh(job.optimize ? OptimizeForMesh(job.shape) : job.shape, &mesh)) {
+        result.bytes = WriteStlFile(mesh, job.path);
+        result.ok = result.bytes >= 0;
+      }
+      break;
+    }
+    case OutputFormat::OPENSCAD_STL:
+      result.bytes = RenderWithOpenScad(job.optimize ? Optimize(job.shape) : job.shape, job.path);
+      result.ok = result.bytes >= 0;
+      break;
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  result.seconds = elapsed.count();
+  return result;
+}
+
+std::vector<OutputResult> WriteOutputs(const std::vector<OutputJob>& jobs, int num_threads) {
+  std::vector<OutputResult> results(jobs.size());
+  ParallelFor(
+      jobs.size(), [&](size_t i) { results[i] = WriteOutput(jobs[i]); }, num_threads);
+  return results;
+}
+
+uint64_t GetOutputKey(const OutputJob& job) {
+  uint64_t key = HashValue(14695981039346656037ull, kOutputCacheVersion);
+  key = HashValue(key, job.shape.hash());
+  key = HashValue(key, static_cast<uint64_t>(job.format));
+  key = HashValue(key, job.optimize);
+  if (job.format == OutputFormat::SCAD) {
+    return key;
+  }
+  VisitNodes(job.shape, [&](const Node& node) {
+    if (node.type != NodeType::IMPORT) {
+      return;
+    }
+    std::string path = GetImportPath(job, node.text);
+    key = HashValue(key, static_cast<uint64_t>(GetFileSize(path)));
+    key = HashValue(key, static_cast<uint64_t>(GetModifiedTime(path)));
+  });
+  return key;
+}
+
+OutputCache::OutputCache(const std::string& cache_directory) : directory_(cache_directory) {
+  std::error_code error;
+  fs::create_directories(directory_, error);
+  if (error) {
+    fprintf(stderr, "Could not create directory %s\n", directory_.c_str());
+    return;
+  }
+  ok_ = true;
+  manifest_ = ReadManifest(directory_ + "/" + kManifestName);
+}
+
+OutputResult OutputCache::Write(const OutputJob& job) {
+  uint64_t key = GetOutputKey(job);
+  OutputResult result = WriteCachedOutput(job, key, directory_, manifest_);
+  std::string path = fs::absolute(job.path).string();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (result.ok) {
+    written_[path] = {key, GetModifiedTime(job.path)};
+    failed_.erase(path);
+  } else {
+    written_.erase(path);
+    failed_.insert(path);
+  }
+  return result;
+}
+
+void OutputCache::Save() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::string& path : failed_) {
+    manifest_.erase(path);
+  }
+  for (const auto& entry : written_) {
+    manifest_[entry.first] = entry.second;
+  }
+  WriteManifest(manifest_, directory_ + "/" + kManifestName);
+}
+
+std::vector<OutputResult> WriteOutputsCached(const std::vector<OutputJob>& jobs,
+                                             const std::string& cache_directory,
+                                             int num_threads) {
+  OutputCache cache(cache_directory);
+  if (!cache.ok()) {
+    return WriteOutputs(jobs, num_threads);
+  }
+  std::vector<OutputResult> results(jobs.size());
+  ParallelFor(
+      jobs.size(), [&](size_t i) { results[i] = cache.Write(jobs[i]); }, num_threads);
+  cache.Save();
+  return results;
+}
+
+}  // namespace scad
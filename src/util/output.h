@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "scad.h"
+
+namespace scad {
+
+enum class OutputFormat {
+  SCAD,
+  // Binary STL, evaluated in process (see EvaluateMesh).
+  STL,
+  // STL rendered by OpenSCAD from the scad file of the shape, which needs openscad on the PATH.
+  // Much slower than STL, but OpenSCAD is the reference the in process meshes are checked against.
+  OPENSCAD_STL,
+};
+
+// A shape to write to a file.
+struct OutputJob {
+  Shape shape;
+  std::string path;
+  OutputFormat format = OutputFormat::SCAD;
+  // Run Optimize (or OptimizeForMesh for meshes) on the shape before writing it.
+  bool optimize = true;
+};
+
+enum class OutputSource {
+  // The file was generated.
+  WRITTEN,
+  // The file was copied from the output cache.
+  CACHED,
+  // The file already held the output, so it was not touched.
+  UP_TO_DATE,
+};
+
+struct OutputResult {
+  std::string path;
+  bool ok = false;
+  long long bytes = 0;
+  double seconds = 0;
+  OutputSource source = OutputSource::WRITTEN;
+};
+
+// Writes every job, running them concurrently on up to num_threads threads (see ParallelFor).
+// Shapes are immutable so jobs can freely share subtrees. Results are in the same order as jobs.
+std::vector<OutputResult> WriteOutputs(const std::vector<OutputJob>& jobs, int num_threads = 0);
+
+// Writes a single job on the calling thread.
+OutputResult WriteOutput(const OutputJob& job);
+
+// Identifies the contents of a job's file: a hash of the structure of its shape (see Shape::hash),
+// its format and options and the version of the code which writes it. Meshes also depend on the
+// files their shape imports, so for them the size and modified time of each of those is included.
+// A scad file only names the files it imports, so its key does not change with them.
+uint64_t GetOutputKey(const OutputJob& job);
+
+// The same as WriteOutputs, but every file written is also kept in cache_directory under its
+// GetOutputKey, so jobs whose shape has not changed since an earlier run are copied from there
+// instead of being generated again. A job is skipped entirely if its file still holds the output
+// from the last time it was written through the cache.
+std::vector<OutputResult> WriteOutputsCached(const std::vector<OutputJob>& jobs,
+                                             const std::string& cache_directory,
+                                             int num_threads = 0);
+
+// The output cache behind WriteOutputsCached, for callers which schedule the jobs themselves.
+class OutputCache {
+ public:
+  // Reads the manifest of cache_directory, creating the directory if it does not exist.
+  explicit OutputCache(const std::string& cache_directory);
+
+  // False if the cache directory could not be created, in which case Write must not be used.
+  bool ok() const {
+    return ok_;
+  }
+
+  // Writes a single job through the cache on the calling thread, skipping it if its file still
+  // holds the output from the last time it was written through the cache. Safe to call
+  // concurrently.
+  OutputResult Write(const OutputJob& job);
+
+  // Records the files written since the cache was created in the manifest, for the next run. Call
+  // once every Write has returned.
+  void Save();
+
+  // What the manifest knows about a file: the key it was last written with and when that was. A
+  // file edited since then has a different modified time, even if its size did not change.
+  struct ManifestEntry {
+    uint64_t key = 0;
+    long long modified_time = -1;
+  };
+
+ private:
+  std::string directory_;
+  bool ok_ = false;
+  // Only read while jobs are written, the changes are kept apart until Save.
+  std::map<std::string, ManifestEntry> manifest_;
+  std::mutex mutex_;
+  std::map<std::string, ManifestEntry> written_;
+  std::set<std::string> failed_;
+};
+
+}  // namespace scad
@@ -0,0 +1,44 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace scad {
+
+int DefaultThreadCount() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void ParallelFor(size_t count, const std::function<void(size_t i)>& fn, int num_threads) {
+  if (num_threads <= 0) {
+    num_threads = DefaultThreadCount();
+  }
+  size_t worker_count = std::min<size_t>(num_threads, count);
+  if (worker_count <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  auto work = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      fn(i);
+    }
+  };
+  // The calling thread is one of the workers.
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < worker_count; ++i) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace scad
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace scad {
+
+// The number of worker threads to use when the caller does not specify one.
+int DefaultThreadCount();
+
+// Calls fn(i) for every i in [0, count) using a pool of up to num_threads worker threads which pull
+// indices until there are none left. Returns once every call has finished. num_threads <= 0 uses
+// DefaultThreadCount(). fn must be safe to call concurrently.
+void ParallelFor(size_t count, const std::function<void(size_t i)>& fn, int num_threads = 0);
+
+}  // namespace scad
@@ -6,72 +6,487 @@
 #endif
 
 #include <math.h>
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "mesh.h"
+#include "scad_writer.h"
+#include "transform.h"
+
 namespace scad {
 
+const double kUnsetArg = std::numeric_limits<double>::quiet_NaN();
+
+bool IsSet(double arg) {
+  return !std::isnan(arg);
+}
+
+namespace {
+
+ResolutionPolicy& MutableResolutionPolicy() {
+  static ResolutionPolicy policy;
+  return policy;
+}
+
+// The fewest segments which keep the sagitta of each chord, r * (1 - cos(pi / n)), within
+// max_error.
+double ChordErrorFragments(double r, double max_error) {
+  if (max_error >= r) {
+    return 3;
+  }
+  return std::max(3.0, std::ceil(M_PI / std::acos(1 - max_error / r)));
+}
+
+// The $fn of a primitive of radius r built with fn, see ResolutionPolicy.
+double DefaultFragments(double r, const Optional<double>& fn) {
+  if (fn.has_value()) {
+    return fn.value();
+  }
+  const ResolutionPolicy& policy = GetResolutionPolicy();
+  return policy.max_chord_error > 0 ? ChordErrorFragments(r, policy.max_chord_error) : policy.fn;
+}
+
+// Nodes are interned by structural hash. The table only holds weak references so geometry that
+// is no longer used is still freed.
+using NodeTable = std::unordered_multimap<uint64_t, std::weak_ptr<const Node>>;
+
+NodeTable& InternTable() {
+  static NodeTable* table = new NodeTable();
+  return *table;
+}
+
+std::mutex& InternMutex() {
+  static std::mutex* mutex = new std::mutex();
+  return *mutex;
+}
+
+void ReleaseNode(const Node* node) {
+  {
+    std::lock_guard<std::mutex> lock(InternMutex());
+    auto& table = InternTable();
+    auto range = table.equal_range(node->hash);
+    for (auto it = range.first; it != range.second;) {
+      it = it->second.expired() ? table.erase(it) : std::next(it);
+    }
+  }
+  // Deleting the node releases its children, which takes the lock again.
+  delete node;
+}
+
+// FNV-1a, used instead of std::hash so hashes are the same in every run and can be persisted.
+const uint64_t kHashSeed = 14695981039346656037ull;
+
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+template <typename T>
+uint64_t HashValue(uint64_t hash, const T& value) {
+  return HashBytes(hash, &value, sizeof(value));
+}
+
+uint64_t HashNode(const Node& node) {
+  uint64_t hash = HashValue(kHashSeed, node.type);
+  hash = HashValue(hash, node.args.size());
+  if (!node.args.empty()) {
+    hash = HashBytes(hash, node.args.data(), node.args.size() * sizeof(double));
+  }
+  hash = HashValue(hash, node.faces.size());
+  for (const auto& face : node.faces) {
+    hash = HashValue(hash, face.size());
+    if (!face.empty()) {
+      hash = HashBytes(hash, face.data(), face.size() * sizeof(int));
+    }
+  }
+  hash = HashValue(hash, node.text.size());
+  hash = HashBytes(hash, node.text.data(), node.text.size());
+  hash = HashValue(hash, node.children.size());
+  for (const Shape& child : node.children) {
+    hash = HashValue(hash, child.hash());
+  }
+  return hash;
+}
+
+// Children are already interned so they can be compared by identity. Arguments are compared
+// bitwise so unset (NaN) arguments compare equal.
+bool SameNode(const Node& a, const Node& b) {
+  if (a.type != b.type || a.args.size() != b.args.size() || a.faces != b.faces ||
+      a.text != b.text || a.children != b.children) {
+    return false;
+  }
+  return a.args.empty() ||
+         std::memcmp(a.args.data(), b.args.data(), a.args.size() * sizeof(double)) == 0;
+}
+
+// The bounds of the 2D shape bounds swept around the z axis, for twisted extrusions.
+Bounds SweptAroundZ(const Bounds& bounds) {
+  double r = 0;
+  for (double x : {bounds.min.x, bounds.max.x}) {
+    for (double y : {bounds.min.y, bounds.max.y}) {
+      r = std::max(r, std::hypot(x, y));
+    }
+  }
+  Bounds swept = bounds;
+  swept.min.x = swept.min.y = -r;
+  swept.max.x = swept.max.y = r;
+  return swept;
+}
+
+// Only called once the bounds of the children are known.
+Bounds ComputeBounds(const Node& node) {
+  const std::vector<double>& args = node.args;
+  Bounds bounds;
+  switch (node.type) {
+    case NodeType::CUBE:
+    case NodeType::SQUARE: {
+      bool center = args.back() != 0;
+      glm::dvec3 size(args[0], args[1], node.type == NodeType::CUBE ? args[2] : 0);
+      bounds.Add(center ? -size / 2.0 : glm::dvec3(0));
+      bounds.Add(center ? size / 2.0 : size);
+      return bounds;
+    }
+    case NodeType::SPHERE:
+      bounds.Add(glm::dvec3(-args[0]));
+      bounds.Add(glm::dvec3(args[0]));
+      return bounds;
+    case NodeType::CIRCLE:
+      bounds.Add(glm::dvec3(-args[0], -args[0], 0));
+      bounds.Add(glm::dvec3(args[0], args[0], 0));
+      return bounds;
+    case NodeType::CYLINDER: {
+      double r = std::max(args[1], args[2]);
+      double z = args[3] != 0 ? -args[0] / 2 : 0;
+      bounds.Add(glm::dvec3(-r, -r, z));
+      bounds.Add(glm::dvec3(r, r, z + args[0]));
+      return bounds;
+    }
+    case NodeType::POLYGON:
+      for (size_t i = 0; i + 1 < args.size(); i += 2) {
+        bounds.Add(glm::dvec3(args[i], args[i + 1], 0));
+      }
+      return bounds;
+    case NodeType::POLYHEDRON:
+      for (size_t i = 1; i + 2 < args.size(); i += 3) {
+        bounds.Add(glm::dvec3(args[i], args[i + 1], args[i + 2]));
+      }
+      return bounds;
+    case NodeType::IMPORT:
+    case NodeType::LITERAL_PRIMITIVE:
+    case NodeType::LITERAL_COMPOSITE:
+      return Bounds::Unbounded();
+    default:
+      break;
+  }
+
+  if (node.children.empty()) {
+    return bounds;
+  }
+  const Bounds& first = node.children[0].bounds();
+  if (IsAffineTransform(node.type)) {
+    return first.Transformed(GetNodeMatrix(node));
+  }
+  switch (node.type) {
+    case NodeType::LINEAR_EXTRUDE: {
+      if (first.empty() || first.unbounded()) {
+        return first;
+      }
+      // The top is the bottom scaled by scale and turned by twist.
+      bounds = first;
+      bounds.Add(first.min * args[5]);
+      bounds.Add(first.max * args[5]);
+      if (args[3] != 0) {
+        bounds = SweptAroundZ(bounds);
+      }
+      bounds.min.z = args[1] != 0 ? -args[0] / 2 : 0;
+      bounds.max.z = bounds.min.z + args[0];
+      return bounds;
+    }
+    case NodeType::PROJECTION:
+      bounds = first;
+      if (!bounds.empty() && !bounds.unbounded()) {
+        bounds.min.z = bounds.max.z = 0;
+      }
+      return bounds;
+    case NodeType::OFFSET_RADIUS:
+    case NodeType::OFFSET_DELTA:
+      bounds = first;
+      if (!bounds.empty() && !bounds.unbounded() && args[0] > 0) {
+        bounds.min -= glm::dvec3(args[0], args[0], 0);
+        bounds.max += glm::dvec3(args[0], args[0], 0);
+      }
+      return bounds;
+    case NodeType::DIFFERENCE:
+      return first;
+    case NodeType::INTERSECTION:
+      bounds = first;
+      for (const Shape& child : node.children) {
+        bounds.min = glm::max(bounds.min, child.bounds().min);
+        bounds.max = glm::min(bounds.max, child.bounds().max);
+      }
+      return bounds.min.x > bounds.max.x || bounds.min.y > bounds.max.y ||
+                     bounds.min.z > bounds.max.z
+                 ? Bounds()
+                 : bounds;
+    case NodeType::MINKOWSKI:
+      bounds.min = bounds.max = glm::dvec3(0);
+      for (const Shape& child : node.children) {
+        if (child.bounds().empty() || child.bounds().unbounded()) {
+          return child.bounds();
+        }
+        bounds.min += child.bounds().min;
+        bounds.max += child.bounds().max;
+      }
+      return bounds;
+    default:
+      // Unions, hulls and modifiers like color.
+      for (const Shape& child : node.children) {
+        bounds.Add(child.bounds());
+      }
+      return bounds;
+  }
+}
+
+}  // namespace
+
+Bounds Bounds::Unbounded() {
+  Bounds bounds;
+  bounds.min = glm::dvec3(-1e300);
+  bounds.max = glm::dvec3(1e300);
+  return bounds;
+}
+
+bool Bounds::Intersects(const Bounds& bounds) const {
+  return min.x <= bounds.max.x && bounds.min.x <= max.x && min.y <= bounds.max.y &&
+         bounds.min.y <= max.y && min.z <= bounds.max.z && bounds.min.z <= max.z;
+}
+
+Bounds Bounds::Transformed(const glm::dmat4& m) const {
+  if (empty() || unbounded()) {
+    return *this;
+  }
+  Bounds bounds;
+  for (int i = 0; i < 8; ++i) {
+    glm::dvec3 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+    bounds.Add(glm::dvec3(m * glm::dvec4(corner, 1.0)));
+  }
+  // A degenerate matrix, like a rotation about a zero axis.
+  if (std::isnan(bounds.min.x + bounds.min.y + bounds.min.z + bounds.max.x + bounds.max.y +
+                 bounds.max.z)) {
+    return Unbounded();
+  }
+  return bounds;
+}
+
+const char* NodeTypeName(NodeType type) {
+  switch (type) {
+    case NodeType::CUBE:
+      return "cube";
+    case NodeType::SQUARE:
+      return "square";
+    case NodeType::SPHERE:
+      return "sphere";
+    case NodeType::CIRCLE:
+      return "circle";
+    case NodeType::CYLINDER:
+      return "cylinder";
+    case NodeType::POLYGON:
+      return "polygon";
+    case NodeType::POLYHEDRON:
+      return "polyhedron";
+    case NodeType::IMPORT:
+      return "import";
+    case NodeType::LITERAL_PRIMITIVE:
+      return "literal_primitive";
+    case NodeType::TRANSLATE:
+      return "translate";
+    case NodeType::ROTATE:
+    case NodeType::ROTATE_AXIS:
+      return "rotate";
+    case NodeType::MIRROR:
+      return "mirror";
+    case NodeType::SCALE:
+      return "scale";
+    case NodeType::MULTMATRIX:
+      return "multmatrix";
+    case NodeType::COLOR:
+    case NodeType::COLOR_NAME:
+    case NodeType::ALPHA:
+      return "color";
+    case NodeType::LINEAR_EXTRUDE:
+      return "linear_extrude";
+    case NodeType::PROJECTION:
+      return "projection";
+    case NodeType::OFFSET_RADIUS:
+    case NodeType::OFFSET_DELTA:
+      return "offset";
+    case NodeType::COMMENT:
+      return "comment";
+    case NodeType::UNION:
+      return "union";
+    case NodeType::DIFFERENCE:
+      return "difference";
+    case NodeType::INTERSECTION:
+      return "intersection";
+    case NodeType::HULL:
+      return "hull";
+    case NodeType::MINKOWSKI:
+      return "minkowski";
+    case NodeType::LITERAL_COMPOSITE:
+      return "literal_composite";
+  }
+  return "unknown";
+}
+
+bool IsPrimitive(NodeType type) {
+  switch (type) {
+    case NodeType::CUBE:
+    case NodeType::SQUARE:
+    case NodeType::SPHERE:
+    case NodeType::CIRCLE:
+    case NodeType::CYLINDER:
+    case NodeType::POLYGON:
+    case NodeType::POLYHEDRON:
+    case NodeType::IMPORT:
+    case NodeType::LITERAL_PRIMITIVE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IsAffineTransform(NodeType type) {
+  switch (type) {
+    case NodeType::TRANSLATE:
+    case NodeType::ROTATE:
+    case NodeType::ROTATE_AXIS:
+    case NodeType::MIRROR:
+    case NodeType::SCALE:
+    case NodeType::MULTMATRIX:
+      return true;
+    default:
+      return false;
+  }
+}
+
 const char* BoolStr(bool b) {
   return b ? "true" : "false";
 }
 
-void WriteIndent(std::FILE* file, int indent_level) {
-  for (int i = 0; i < indent_level * kTabSize; ++i) {
-    fputc(' ', file);
+std::vector<const Node*> FindSharedNodes(const Shape& shape) {
+  std::unordered_map<const Node*, int> references;
+  std::vector<const Node*> order;
+  VisitNodes(shape, [&](const Node& node) {
+    order.push_back(&node);
+    for (const Shape& child : node.children) {
+      if (!child.empty()) {
+        ++references[child.node()];
+      }
+    }
+  });
+
+  std::vector<const Node*> shared;
+  for (const Node* node : order) {
+    // Primitives are a single line so a module would not make the output any smaller.
+    if (references[node] > 1 && !IsPrimitive(node->type)) {
+      shared.push_back(node);
+    }
   }
+  return shared;
+}
+
+void VisitNodes(const Shape& shape, const std::function<void(const Node& node)>& fn) {
+  std::unordered_set<const Node*> visited;
+  std::function<void(const Shape&)> visit = [&](const Shape& s) {
+    const Node* node = s.node();
+    if (node == nullptr || !visited.insert(node).second) {
+      return;
+    }
+    for (const Shape& child : node->children) {
+      visit(child);
+    }
+    fn(*node);
+  };
+  visit(shape);
 }
 
-void WriteComposite(std::FILE* file,
-                    const std::function<void(std::FILE*)>& write_name,
-                    const std::vector<Shape>& shapes,
-                    int indent_level) {
-  WriteIndent(file, indent_level);
-  write_name(file);
-  fprintf(file, " {\n");
-  for (const Shape& s : shapes) {
-    s.AppendScad(file, indent_level + 1);
+Shape Shape::Create(Node node) {
+  node.hash = HashNode(node);
+  node.bounds = ComputeBounds(node);
+
+  std::lock_guard<std::mutex> lock(InternMutex());
+  auto& table = InternTable();
+  auto range = table.equal_range(node.hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    std::shared_ptr<const Node> existing = it->second.lock();
+    if (existing && SameNode(*existing, node)) {
+      return Shape(std::move(existing));
+    }
   }
-  WriteIndent(file, indent_level);
-  fprintf(file, "}\n");
+  std::shared_ptr<const Node> interned(new Node(std::move(node)), ReleaseNode);
+  table.emplace(interned->hash, interned);
+  return Shape(std::move(interned));
+}
+
+uint64_t Shape::hash() const {
+  return node_ ? node_->hash : 0;
+}
+
+const Bounds& Shape::bounds() const {
+  static const Bounds empty;
+  return node_ ? node_->bounds : empty;
+}
+
+size_t NumInternedNodes() {
+  std::lock_guard<std::mutex> lock(InternMutex());
+  return InternTable().size();
 }
 
-Shape Shape::Composite(const std::function<void(std::FILE*)>& write_name,
+Shape Shape::Composite(NodeType type,
+                       const std::vector<double>& args,
                        const std::vector<Shape>& shapes) {
-  return Shape([=](std::FILE* file, int indent_level) {
-    WriteComposite(file, write_name, shapes, indent_level);
-  });
+  Node node;
+  node.type = type;
+  node.args = args;
+  node.children = shapes;
+  return Create(std::move(node));
 }
 
 Shape Shape::LiteralComposite(const std::string& name, const std::vector<Shape>& shapes) {
-  return Shape([=](std::FILE* file, int indent_level) {
-    WriteComposite(
-        file, [=](std::FILE*) { fprintf(file, "%s", name.c_str()); }, shapes, indent_level);
-  });
+  Node node;
+  node.type = NodeType::LITERAL_COMPOSITE;
+  node.text = name;
+  node.children = shapes;
+  return Create(std::move(node));
 }
 
-Shape Shape::Primitive(const std::function<void(std::FILE*)>& scad_writer) {
-  return Shape([=](std::FILE* file, int indent_level) {
-    WriteIndent(file, indent_level);
-    scad_writer(file);
-    fprintf(file, "\n");
-  });
+Shape Shape::Primitive(NodeType type, const std::vector<double>& args) {
+  return Composite(type, args, {});
 }
 
 Shape Shape::LiteralPrimitive(const std::string& primitive) {
-  return Primitive([=](std::FILE* file) { fprintf(file, "%s", primitive.c_str()); });
+  Node node;
+  node.type = NodeType::LITERAL_PRIMITIVE;
+  node.text = primitive;
+  return Create(std::move(node));
 }
 
 Shape Cube(const CubeParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file,
-            "cube (size = [ %.3f, %.3f, %.3f], center = %s);",
-            params.x,
-            params.y,
-            params.z,
-            BoolStr(params.center));
-  });
+  return Shape::Primitive(NodeType::CUBE, {params.x, params.y, params.z, (double)params.center});
 }
 
 Shape Cube(double x, double y, double z, bool center) {
@@ -88,13 +503,7 @@ Shape Cube(double size, bool center) {
 }
 
 Shape Square(const SquareParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file,
-            "square (size = [%.3f, %.3f], center = %s);",
-            params.x,
-            params.y,
-            BoolStr(params.center));
-  });
+  return Shape::Primitive(NodeType::SQUARE, {params.x, params.y, (double)params.center});
 }
 
 Shape Square(double x, double y, bool center) {
@@ -109,20 +518,30 @@ Shape Square(double size, bool center) {
   return Square(size, size, center);
 }
 
+void SetResolutionPolicy(const ResolutionPolicy& policy) {
+  MutableResolutionPolicy() = policy;
+}
+
+const ResolutionPolicy& GetResolutionPolicy() {
+  return MutableResolutionPolicy();
+}
+
+double Resolution(const std::string& feature, double r, double default_fn) {
+  const ResolutionPolicy& policy = GetResolutionPolicy();
+  auto it = policy.feature_fn.find(feature);
+  if (it != policy.feature_fn.end()) {
+    return it->second;
+  }
+  return policy.max_chord_error > 0 ? ChordErrorFragments(r, policy.max_chord_error) : default_fn;
+}
+
 Shape Sphere(const SphereParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file, "sphere (r = %.3f", params.r);
-    if (params.fs.has_value()) {
-      fprintf(file, ", $fs = %.3f", params.fs.value());
-    }
-    if (params.fn.has_value()) {
-      fprintf(file, ", $fn = %.3f", params.fn.value());
-    }
-    if (params.fa.has_value()) {
-      fprintf(file, ", $fa = %.3f", params.fa.value());
-    }
-    fprintf(file, ");");
-  });
+  const ResolutionPolicy& policy = GetResolutionPolicy();
+  return Shape::Primitive(NodeType::SPHERE,
+                          {params.r,
+                           DefaultFragments(params.r, params.fn),
+                           params.fa.has_value() ? params.fa.value() : policy.fa,
+                           params.fs.has_value() ? params.fs.value() : policy.fs});
 }
 
 Shape Sphere(double radius) {
@@ -139,19 +558,12 @@ Shape Sphere(double radius, double fn) {
 }
 
 Shape Circle(const CircleParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file, "circle (r = %.3f", params.r);
-    if (params.fs.has_value()) {
-      fprintf(file, ", $fs = %.3f", params.fs.value());
-    }
-    if (params.fn.has_value()) {
-      fprintf(file, ", $fn = %.3f", params.fn.value());
-    }
-    if (params.fa.has_value()) {
-      fprintf(file, ", $fa = %.3f", params.fa.value());
-    }
-    fprintf(file, ");");
-  });
+  const ResolutionPolicy& policy = GetResolutionPolicy();
+  return Shape::Primitive(NodeType::CIRCLE,
+                          {params.r,
+                           DefaultFragments(params.r, params.fn),
+                           params.fa.has_value() ? params.fa.value() : policy.fa,
+                           params.fs.has_value() ? params.fs.value() : policy.fs});
 }
 
 Shape Circle(double radius) {
@@ -168,18 +580,15 @@ Shape Circle(double radius, double fn) {
 }
 
 Shape Cylinder(const CylinderParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file,
-            "cylinder(h = %.3f, r1 = %.3f, r2 = %.3f, center = %s",
-            params.h,
-            params.r1,
-            params.r2,
-            BoolStr(params.center));
-    if (params.fn.has_value()) {
-      fprintf(file, ", $fn = %.3f", params.fn.value());
-    }
-    fprintf(file, ");");
-  });
+  const ResolutionPolicy& policy = GetResolutionPolicy();
+  double r = std::max(params.r1, params.r2);
+  double fn = DefaultFragments(r, params.fn);
+  // Cylinders have no $fa and $fs arguments, so the defaults are applied here.
+  if (!IsSet(fn) && (IsSet(policy.fa) || IsSet(policy.fs))) {
+    fn = GetFragments(r, kUnsetArg, policy.fs, policy.fa);
+  }
+  return Shape::Primitive(NodeType::CYLINDER,
+                          {params.h, params.r1, params.r2, (double)params.center, fn});
 }
 
 Shape Cylinder(double height, double radius, Optional<double> fn) {
@@ -192,17 +601,13 @@ Shape Cylinder(double height, double radius, Optional<double> fn) {
 }
 
 Shape Polygon(const std::vector<Point2d>& points) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file, "polygon (points = [");
-    for (size_t i = 0; i < points.size(); ++i) {
-      const Point2d& p = points[i];
-      if (i != 0) {
-        fputc(',', file);
-      }
-      fprintf(file, "[%.3f, %.3f]", p.x, p.y);
-    }
-    fprintf(file, "]);");
-  });
+  std::vector<double> args;
+  args.reserve(points.size() * 2);
+  for (const Point2d& p : points) {
+    args.push_back(p.x);
+    args.push_back(p.y);
+  }
+  return Shape::Primitive(NodeType::POLYGON, args);
 }
 
 Shape RegularPolygon(int n, double r) {
@@ -217,55 +622,37 @@ Shape RegularPolygon(int n, double r) {
 Shape Polyhedron(const std::vector<Point3d>& points,
                  const std::vector<std::vector<int>>& faces,
                  int convexity) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file, "polyhedron (points = [");
-    for (size_t i = 0; i < points.size(); ++i) {
-      const Point3d& p = points[i];
-      if (i > 0) {
-        fputc(',', file);
-      }
-      fprintf(file, "[%.3f, %.3f, %.3f]", p.x, p.y, p.z);
-    }
-    fprintf(file, "], faces = [");
-    for (size_t i = 0; i < faces.size(); ++i) {
-      if (i > 0) {
-        fputc(',', file);
-      }
-      const auto& face = faces[i];
-      fprintf(file, "[");
-      for (size_t f = 0; f < face.size(); ++f) {
-        if (f != 0) {
-          fputc(',', file);
-        }
-        fprintf(file, "%d", face[f]);
-      }
-      fprintf(file, "]");
-    }
-    fprintf(file, "], convexity = %d);", convexity);
-  });
+  Node node;
+  node.type = NodeType::POLYHEDRON;
+  node.args.reserve(1 + points.size() * 3);
+  node.args.push_back(convexity);
+  for (const Point3d& p : points) {
+    node.args.push_back(p.x);
+    node.args.push_back(p.y);
+    node.args.push_back(p.z);
+  }
+  node.faces = faces;
+  return Shape::Create(std::move(node));
 }
 
 Shape HullAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("hull ()", shapes);
+  return Shape::Composite(NodeType::HULL, {}, shapes);
 }
 
 Shape UnionAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("union ()", shapes);
+  return Shape::Composite(NodeType::UNION, {}, shapes);
 }
 
 Shape DifferenceAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("difference ()", shapes);
+  return Shape::Composite(NodeType::DIFFERENCE, {}, shapes);
 }
 
 Shape IntersectionAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("intersection ()", shapes);
+  return Shape::Composite(NodeType::INTERSECTION, {}, shapes);
 }
 
 Shape Shape::Translate(double x, double y, double z) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "translate ([%.3f, %.3f, %.3f])", x, y, z);
-  };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(NodeType::TRANSLATE, {x, y, z}, {*this});
 }
 
 Shape Shape::TranslateX(double x) const {
@@ -281,22 +668,15 @@ Shape Shape::TranslateZ(double z) const {
 }
 
 Shape Shape::Mirror(double x, double y, double z) const {
-  auto write_name = [=](std::FILE* file) { fprintf(file, "mirror ([%.3f, %.3f, %.3f])", x, y, z); };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(NodeType::MIRROR, {x, y, z}, {*this});
 }
 
 Shape Shape::Rotate(double rx, double ry, double rz) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "rotate ([%.3f, %.3f, %.3f])", rx, ry, rz);
-  };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(NodeType::ROTATE, {rx, ry, rz}, {*this});
 }
 
 Shape Shape::Rotate(double degrees, double x, double y, double z) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "rotate (a = %.3f, v = [%.3f, %.3f, %.3f])", degrees, x, y, z);
-  };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(NodeType::ROTATE_AXIS, {degrees, x, y, z}, {*this});
 }
 
 Shape Shape::RotateX(double degrees) const {
@@ -312,18 +692,14 @@ Shape Shape::RotateZ(double degrees) const {
 }
 
 Shape Shape::LinearExtrude(const LinearExtrudeParams& params) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file,
-            "linear_extrude (height = %.3f, center = %s, convexity = %.3f, "
-            "twist = %.3f, slices = %d, scale = %.3f)",
-            params.height,
-            BoolStr(params.center),
-            params.convexity,
-            params.twist,
-            params.slices,
-            params.scale);
-  };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(NodeType::LINEAR_EXTRUDE,
+                          {params.height,
+                           (double)params.center,
+                           params.convexity,
+                           params.twist,
+                           (double)params.slices,
+                           params.scale},
+                          {*this});
 }
 
 Shape Shape::LinearExtrude(double height) const {
@@ -333,43 +709,40 @@ Shape Shape::LinearExtrude(double height) const {
 }
 
 Shape Shape::Color(double r, double g, double b, double a) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "color (c = [%.3f, %.3f, %.3f, %.3f])", r, g, b, a);
-  };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(NodeType::COLOR, {r, g, b, a}, {*this});
 }
 
 Shape Shape::Color(const std::string& color, double a) const {
-  auto write_name = [=](std::FILE* file) { fprintf(file, "color (\"%s\", %f)", color.c_str(), a); };
-  return Shape::Composite(write_name, {*this});
+  Node node;
+  node.type = NodeType::COLOR_NAME;
+  node.args = {a};
+  node.text = color;
+  node.children = {*this};
+  return Shape::Create(std::move(node));
 }
 
 Shape Shape::Alpha(double a) const {
-  auto write_name = [=](std::FILE* file) { fprintf(file, "color (alpha = %.3f)", a); };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(NodeType::ALPHA, {a}, {*this});
 }
 
 Shape Shape::Scale(double x, double y, double z) const {
-  auto write_name = [=](std::FILE* file) { fprintf(file, "scale ([%.3f, %.3f, %.3f])", x, y, z); };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(NodeType::SCALE, {x, y, z}, {*this});
 }
 
 Shape Shape::Scale(double s) const {
   return Scale(s, s, s);
 }
 
+Shape Shape::MultMatrix(const std::vector<double>& matrix) const {
+  return Shape::Composite(NodeType::MULTMATRIX, matrix, {*this});
+}
+
 Shape Shape::OffsetRadius(double r, bool chamfer) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "offset (r = %.3f, chamfer = %s)", r, BoolStr(chamfer));
-  };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(NodeType::OFFSET_RADIUS, {r, (double)chamfer}, {*this});
 }
 
 Shape Shape::OffsetDelta(double delta, bool chamfer) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "offset (delta = %.3f, chamfer = %s)", delta, BoolStr(chamfer));
-  };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(NodeType::OFFSET_DELTA, {delta, (double)chamfer}, {*this});
 }
 
 Shape Shape::Subtract(const Shape& other) const {
@@ -399,56 +772,31 @@ Shape& Shape::operator+=(const Shape& other) {
 }
 
 Shape Shape::Comment(const std::string& comment) const {
-  Shape shape_copy = *this;
-  return Shape([=](std::FILE* file, int indent_level) {
-    WriteIndent(file, indent_level);
-    fprintf(file, "/* %s */\n", comment.c_str());
-    shape_copy.AppendScad(file, indent_level);
-  });
+  Node node;
+  node.type = NodeType::COMMENT;
+  node.text = comment;
+  node.children = {*this};
+  return Shape::Create(std::move(node));
 }
 
 Shape Shape::Projection(bool cut) const {
-  auto write_name = [=](std::FILE* file) { fprintf(file, "projection (cut = %s)", BoolStr(cut)); };
-  return Shape::Composite(write_name, {*this});
-}
-
-void Shape::AppendScad(std::FILE* file, int indent_level) const {
-  if (!scad_) {
-    return;
-  }
-  (*scad_)(file, indent_level);
+  return Shape::Composite(NodeType::PROJECTION, {(double)cut}, {*this});
 }
 
 void Shape::WriteToFile(const std::string& file_name) const {
-  std::FILE* file = nullptr;
-  bool opened = false;
-#ifdef _WIN32
-  opened = fopen_s(&file, file_name.c_str(), "w") == 0;
-#else
-  file = std::fopen(file_name.c_str(), "w");
-  opened = file != nullptr;
-#endif
-
-  if (!opened || file == nullptr) {
-    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
-    return;
-  }
-  AppendScad(file, 0);
-  std::fclose(file);
+  WriteScadFile(*this, file_name);
 }
 
 Shape Import(const std::string& file_name, int convexity) {
-  return Shape::Primitive([=](std::FILE* file) {
-    if (convexity > 0) {
-      fprintf(file, "import (file = \"%s\", convexity = %d);", file_name.c_str(), convexity);
-    } else {
-      fprintf(file, "import (file = \"%s\");", file_name.c_str());
-    }
-  });
+  Node node;
+  node.type = NodeType::IMPORT;
+  node.args = {(double)convexity};
+  node.text = file_name;
+  return Shape::Create(std::move(node));
 }
 
 Shape Minkowski(const Shape& first, const Shape& second) {
-  return Shape::LiteralComposite("minkowski ()", {first, second});
+  return Shape::Composite(NodeType::MINKOWSKI, {}, {first, second});
 }
 
 }  // namespace scad
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
 #include <functional>
+#include <glm/glm.hpp>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -15,8 +19,6 @@ namespace scad {
 
 const int kTabSize = 2;
 
-using ScadWriter = std::function<void(std::FILE* file, int indent_level)>;
-
 template <typename T>
 class Optional {
  public:
@@ -39,6 +41,54 @@ class Optional {
   bool has_value_ = false;
 };
 
+// The kind of a node in the shape graph. The meaning of Node::args depends on the type and is
+// listed next to each entry. Optional arguments are stored as kUnsetArg when they are not set.
+enum class NodeType {
+  // Primitives, these have no children.
+  CUBE,               // x, y, z, center
+  SQUARE,             // x, y, center
+  SPHERE,             // r, fn, fa, fs
+  CIRCLE,             // r, fn, fa, fs
+  CYLINDER,           // h, r1, r2, center, fn
+  POLYGON,            // x0, y0, x1, y1, ...
+  POLYHEDRON,         // convexity, x0, y0, z0, x1, y1, z1, ... (faces are in Node::faces)
+  IMPORT,             // convexity (text is the file name)
+  LITERAL_PRIMITIVE,  // (text is written verbatim)
+
+  // Transforms and modifiers, these have a single child.
+  TRANSLATE,       // x, y, z
+  ROTATE,          // rx, ry, rz
+  ROTATE_AXIS,     // degrees, x, y, z
+  MIRROR,          // x, y, z
+  SCALE,           // x, y, z
+  MULTMATRIX,      // 4x4 affine matrix in row major order
+  COLOR,           // r, g, b, a
+  COLOR_NAME,      // a (text is the color name)
+  ALPHA,           // a
+  LINEAR_EXTRUDE,  // height, center, convexity, twist, slices, scale
+  PROJECTION,      // cut
+  OFFSET_RADIUS,   // r, chamfer
+  OFFSET_DELTA,    // delta, chamfer
+  COMMENT,         // (text is the comment)
+
+  // Operations over any number of children.
+  UNION,
+  DIFFERENCE,
+  INTERSECTION,
+  HULL,
+  MINKOWSKI,
+  LITERAL_COMPOSITE,  // (text is the operation written verbatim)
+};
+
+const char* NodeTypeName(NodeType type);
+bool IsPrimitive(NodeType type);
+// Translate, rotate, mirror, scale and multmatrix.
+bool IsAffineTransform(NodeType type);
+
+// Stored in Node::args for optional arguments which were not set.
+extern const double kUnsetArg;
+bool IsSet(double arg);
+
 struct LinearExtrudeParams {
   double height = 0;
   double twist = 0;
@@ -48,23 +98,81 @@ struct LinearExtrudeParams {
   bool center = true;
 };
 
+// An axis aligned box which contains a shape. Bounds are conservative: they may be larger than
+// the shape but never smaller. 2D shapes are flat at z = 0.
+struct Bounds {
+  glm::dvec3 min = glm::dvec3(1e300);
+  glm::dvec3 max = glm::dvec3(-1e300);
+
+  // For shapes whose extent is not known, like imports.
+  static Bounds Unbounded();
+
+  bool empty() const {
+    return min.x > max.x;
+  }
+  bool unbounded() const {
+    return min.x <= -1e300;
+  }
+  void Add(const glm::dvec3& p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+  void Add(const Bounds& bounds) {
+    min = glm::min(min, bounds.min);
+    max = glm::max(max, bounds.max);
+  }
+  // Boxes which only touch count as intersecting.
+  bool Intersects(const Bounds& bounds) const;
+  // The bounds of the box after the affine transform m.
+  Bounds Transformed(const glm::dmat4& m) const;
+};
+
+struct Node;
+
+// An immutable handle to a node in the shape graph. Copying a shape is cheap and the copies share
+// the same node, so a shape built out of other shapes forms a DAG rather than a tree. A default
+// constructed shape is empty and is skipped by everything that consumes shapes.
 class Shape {
  public:
   Shape() {
   }
-  explicit Shape(std::shared_ptr<ScadWriter> scad) : scad_(std::move(scad)) {
-  }
-  explicit Shape(ScadWriter scad) : scad_(std::make_shared<ScadWriter>(std::move(scad))) {
+  explicit Shape(std::shared_ptr<const Node> node) : node_(std::move(node)) {
   }
 
-  static Shape Composite(const std::function<void(std::FILE*)>& write_name,
+  // Returns a shape for node. Structurally identical nodes are interned, so building the same
+  // geometry twice returns the same node and shapes can be compared by node identity.
+  static Shape Create(Node node);
+  static Shape Composite(NodeType type,
+                         const std::vector<double>& args,
                          const std::vector<Shape>& shapes);
   static Shape LiteralComposite(const std::string& name, const std::vector<Shape>& shapes);
-  static Shape Primitive(const std::function<void(std::FILE*)>& scad_writer);
+  static Shape Primitive(NodeType type, const std::vector<double>& args);
   static Shape LiteralPrimitive(const std::string& primitive);
 
+  bool empty() const {
+    return node_ == nullptr;
+  }
+  // Null for an empty shape.
+  const Node* node() const {
+    return node_.get();
+  }
+  const std::shared_ptr<const Node>& node_ptr() const {
+    return node_;
+  }
+  // Structural hash of the whole subtree. Zero for an empty shape. Stable between runs.
+  uint64_t hash() const;
+  // Empty for an empty shape.
+  const Bounds& bounds() const;
+
+  bool operator==(const Shape& other) const {
+    return node_ == other.node_;
+  }
+  bool operator!=(const Shape& other) const {
+    return node_ != other.node_;
+  }
+
+  // Writes the shape with a ScadWriter, see scad_writer.h.
   void WriteToFile(const std::string& file_name) const;
-  void AppendScad(std::FILE* file, int indent_level) const;
 
   Shape SCAD_WARN_UNUSED_RESULT Translate(double x, double y, double z) const;
   Shape SCAD_WARN_UNUSED_RESULT TranslateX(double x) const;
@@ -107,6 +215,9 @@ class Shape {
   Shape SCAD_WARN_UNUSED_RESULT Scale(double x, double y, double z) const;
   Shape SCAD_WARN_UNUSED_RESULT Scale(double s) const;
 
+  // matrix is a 4x4 affine transform in row major order.
+  Shape SCAD_WARN_UNUSED_RESULT MultMatrix(const std::vector<double>& matrix) const;
+
   Shape SCAD_WARN_UNUSED_RESULT OffsetRadius(double r, bool chamfer = false) const;
   Shape SCAD_WARN_UNUSED_RESULT OffsetDelta(double delta, bool chamfer = false) const;
 
@@ -115,9 +226,54 @@ class Shape {
   Shape SCAD_WARN_UNUSED_RESULT Projection(bool cut = false) const;
 
  private:
-  std::shared_ptr<const ScadWriter> scad_;
+  std::shared_ptr<const Node> node_;
+};
+
+struct Node {
+  NodeType type = NodeType::UNION;
+  std::vector<double> args;
+  // Only used by POLYHEDRON.
+  std::vector<std::vector<int>> faces;
+  std::string text;
+  std::vector<Shape> children;
+  // Set by Shape::Create.
+  uint64_t hash = 0;
+  Bounds bounds;
 };
 
+// The number of distinct nodes currently alive in the intern table.
+size_t NumInternedNodes();
+
+// Calls fn once for every distinct node reachable from shape. Children are visited before their
+// parents and a node shared by several parents is only visited the first time it is reached.
+void VisitNodes(const Shape& shape, const std::function<void(const Node& node)>& fn);
+
+// How finely spheres, circles and cylinders are divided into segments, for every primitive built
+// after it is set. A primitive built with a $fn keeps it, features which hard code their $fn get it
+// through Resolution so the policy can override it. Primitives built without a $fn get one from
+// max_chord_error if it is set, and otherwise the defaults below.
+//
+// The default policy leaves everything to the callers and OpenSCAD.
+struct ResolutionPolicy {
+  // Defaults for OpenSCAD's special variables. kUnsetArg leaves them to OpenSCAD.
+  double fn = kUnsetArg;
+  double fa = kUnsetArg;
+  double fs = kUnsetArg;
+  // If above zero, every primitive gets the fewest segments which keep each chord within this many
+  // mm of the true curve. The one knob which trades mesh size and render time against fidelity.
+  double max_chord_error = 0;
+  // $fn by feature name.
+  std::map<std::string, double, std::less<>> feature_fn;
+};
+
+// Not thread safe, set the policy before building any shapes.
+void SetResolutionPolicy(const ResolutionPolicy& policy);
+const ResolutionPolicy& GetResolutionPolicy();
+
+// The $fn for a named curved feature of radius r: the feature_fn for it in the policy, or the one
+// from max_chord_error, or default_fn.
+double Resolution(const std::string& feature, double r, double default_fn);
+
 struct CubeParams {
   double x = 1;
   double y = 1;
@@ -217,10 +373,7 @@ Shape SCAD_WARN_UNUSED_RESULT Import(const std::string& file_name, int convexity
 Shape SCAD_WARN_UNUSED_RESULT Minkowski(const Shape& first, const Shape& second);
 
 const char* BoolStr(bool b);
-void WriteIndent(std::FILE* file, int indent_level);
-void WriteComposite(std::FILE* file,
-                    const std::function<void(std::FILE*)>& write_name,
-                    const std::vector<Shape>& shapes,
-                    int indent_level);
+// The non primitive nodes of shape which have more than one parent, children before parents.
+std::vector<const Node*> FindSharedNodes(const Shape& shape);
 
 }  // namespace scad
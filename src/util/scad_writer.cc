@@ -0,0 +1,428 @@
+#include "scad_writer.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "scad.h"
+
+namespace scad {
+namespace {
+
+// Enough for any number written with fixed notation and the precisions used here.
+constexpr size_t kMaxNumberSize = 512;
+
+// Polyhedron points are usually computed (for example by EvaluateHulls) and rounding them as
+// coarsely as other arguments can fold thin faces over each other.
+constexpr int kPointPrecision = 6;
+
+constexpr size_t kIndentSize = 256;
+const std::string& Spaces() {
+  static const std::string* spaces = new std::string(kIndentSize, ' ');
+  return *spaces;
+}
+
+}  // namespace
+
+ScadWriter::ScadWriter(std::FILE* file) : file_(file), buffer_(new char[kBufferSize]) {
+}
+
+ScadWriter::ScadWriter(std::string* out) : out_(out), buffer_(new char[kBufferSize]) {
+}
+
+ScadWriter::~ScadWriter() {
+  Flush();
+}
+
+bool ScadWriter::Flush() {
+  if (size_ > 0) {
+    if (file_) {
+      failed_ |= std::fwrite(buffer_.get(), 1, size_, file_) != size_;
+    } else if (out_) {
+      out_->append(buffer_.get(), size_);
+    }
+    flushed_ += size_;
+    size_ = 0;
+  }
+  return !failed_;
+}
+
+void ScadWriter::Reserve(size_t size) {
+  if (kBufferSize - size_ < size) {
+    Flush();
+  }
+}
+
+void ScadWriter::Append(std::string_view s) {
+  while (!s.empty()) {
+    if (size_ == kBufferSize) {
+      Flush();
+    }
+    size_t n = std::min(s.size(), kBufferSize - size_);
+    std::memcpy(buffer_.get() + size_, s.data(), n);
+    size_ += n;
+    s.remove_prefix(n);
+  }
+}
+
+void ScadWriter::Append(char c) {
+  Reserve(1);
+  buffer_[size_++] = c;
+}
+
+void ScadWriter::AppendIndent(int indent_level) {
+  size_t count = indent_level * kTabSize;
+  while (count > 0) {
+    size_t n = std::min(count, kIndentSize);
+    Append(std::string_view(Spaces().data(), n));
+    count -= n;
+  }
+}
+
+void ScadWriter::AppendNumber(double value, int precision) {
+  Reserve(kMaxNumberSize);
+  char* begin = buffer_.get() + size_;
+  auto result =
+      std::to_chars(begin, begin + kMaxNumberSize, value, std::chars_format::fixed, precision);
+  size_ += result.ptr - begin;
+}
+
+void ScadWriter::AppendInt(long long value) {
+  Reserve(kMaxNumberSize);
+  char* begin = buffer_.get() + size_;
+  auto result = std::to_chars(begin, begin + kMaxNumberSize, value);
+  size_ += result.ptr - begin;
+}
+
+void ScadWriter::AppendBool(double value) {
+  Append(BoolStr(value));
+}
+
+void ScadWriter::WriteArgs(const std::vector<double>& args,
+                           size_t start,
+                           size_t count,
+                           int precision) {
+  for (size_t i = start; i < start + count; ++i) {
+    if (i != start) {
+      Append(", ");
+    }
+    AppendNumber(args[i], precision);
+  }
+}
+
+void ScadWriter::WriteResolution(const Node& node) {
+  double fn = node.args[1];
+  double fa = node.args[2];
+  double fs = node.args[3];
+  if (IsSet(fs)) {
+    Append(", $fs = ");
+    AppendNumber(fs);
+  }
+  if (IsSet(fn)) {
+    Append(", $fn = ");
+    AppendNumber(fn);
+  }
+  if (IsSet(fa)) {
+    Append(", $fa = ");
+    AppendNumber(fa);
+  }
+}
+
+void ScadWriter::WritePrimitive(const Node& node) {
+  const std::vector<double>& args = node.args;
+  switch (node.type) {
+    case NodeType::CUBE:
+      Append("cube (size = [ ");
+      WriteArgs(args, 0, 3);
+      Append("], center = ");
+      AppendBool(args[3]);
+      Append(");");
+      break;
+    case NodeType::SQUARE:
+      Append("square (size = [");
+      WriteArgs(args, 0, 2);
+      Append("], center = ");
+      AppendBool(args[2]);
+      Append(");");
+      break;
+    case NodeType::SPHERE:
+    case NodeType::CIRCLE:
+      Append(NodeTypeName(node.type));
+      Append(" (r = ");
+      AppendNumber(args[0]);
+      WriteResolution(node);
+      Append(");");
+      break;
+    case NodeType::CYLINDER:
+      Append("cylinder(h = ");
+      AppendNumber(args[0]);
+      Append(", r1 = ");
+      AppendNumber(args[1]);
+      Append(", r2 = ");
+      AppendNumber(args[2]);
+      Append(", center = ");
+      AppendBool(args[3]);
+      if (IsSet(args[4])) {
+        Append(", $fn = ");
+        AppendNumber(args[4]);
+      }
+      Append(");");
+      break;
+    case NodeType::POLYGON:
+      Append("polygon (points = [");
+      for (size_t i = 0; i < args.size(); i += 2) {
+        if (i != 0) {
+          Append(',');
+        }
+        Append('[');
+        WriteArgs(args, i, 2);
+        Append(']');
+      }
+      Append("]);");
+      break;
+    case NodeType::POLYHEDRON:
+      Append("polyhedron (points = [");
+      for (size_t i = 1; i < args.size(); i += 3) {
+        if (i > 1) {
+          Append(',');
+        }
+        Append('[');
+        WriteArgs(args, i, 3, kPointPrecision);
+        Append(']');
+      }
+      Append("], faces = [");
+      for (size_t i = 0; i < node.faces.size(); ++i) {
+        if (i > 0) {
+          Append(',');
+        }
+        const auto& face = node.faces[i];
+        Append('[');
+        for (size_t f = 0; f < face.size(); ++f) {
+          if (f != 0) {
+            Append(',');
+          }
+          AppendInt(face[f]);
+        }
+        Append(']');
+      }
+      Append("], convexity = ");
+      AppendInt((int)args[0]);
+      Append(");");
+      break;
+    case NodeType::IMPORT:
+      Append("import (file = \"");
+      Append(node.text);
+      Append('"');
+      if (args[0] > 0) {
+        Append(", convexity = ");
+        AppendInt((int)args[0]);
+      }
+      Append(");");
+      break;
+    case NodeType::LITERAL_PRIMITIVE:
+      Append(node.text);
+      break;
+    default:
+      break;
+  }
+}
+
+void ScadWriter::WriteCompositeName(const Node& node) {
+  const std::vector<double>& args = node.args;
+  switch (node.type) {
+    case NodeType::TRANSLATE:
+    case NodeType::MIRROR:
+    case NodeType::SCALE:
+    case NodeType::ROTATE:
+      Append(NodeTypeName(node.type));
+      Append(" ([");
+      WriteArgs(args, 0, 3);
+      Append("])");
+      break;
+    case NodeType::ROTATE_AXIS:
+      Append("rotate (a = ");
+      AppendNumber(args[0]);
+      Append(", v = [");
+      WriteArgs(args, 1, 3);
+      Append("])");
+      break;
+    case NodeType::MULTMATRIX:
+      // Rotations need more precision than the other arguments.
+      Append("multmatrix ([");
+      for (int row = 0; row < 4; ++row) {
+        Append(row == 0 ? "[" : ", [");
+        for (int col = 0; col < 4; ++col) {
+          if (col != 0) {
+            Append(", ");
+          }
+          AppendNumber(args[row * 4 + col], 6);
+        }
+        Append(']');
+      }
+      Append("])");
+      break;
+    case NodeType::COLOR:
+      Append("color (c = [");
+      WriteArgs(args, 0, 4);
+      Append("])");
+      break;
+    case NodeType::COLOR_NAME:
+      Append("color (\"");
+      Append(node.text);
+      Append("\", ");
+      AppendNumber(args[0], 6);
+      Append(')');
+      break;
+    case NodeType::ALPHA:
+      Append("color (alpha = ");
+      AppendNumber(args[0]);
+      Append(')');
+      break;
+    case NodeType::LINEAR_EXTRUDE:
+      Append("linear_extrude (height = ");
+      AppendNumber(args[0]);
+      Append(", center = ");
+      AppendBool(args[1]);
+      Append(", convexity = ");
+      AppendNumber(args[2]);
+      Append(", twist = ");
+      AppendNumber(args[3]);
+      Append(", slices = ");
+      AppendInt((int)args[4]);
+      Append(", scale = ");
+      AppendNumber(args[5]);
+      Append(')');
+      break;
+    case NodeType::PROJECTION:
+      Append("projection (cut = ");
+      AppendBool(args[0]);
+      Append(')');
+      break;
+    case NodeType::OFFSET_RADIUS:
+    case NodeType::OFFSET_DELTA:
+      Append(node.type == NodeType::OFFSET_RADIUS ? "offset (r = " : "offset (delta = ");
+      AppendNumber(args[0]);
+      Append(", chamfer = ");
+      AppendBool(args[1]);
+      Append(')');
+      break;
+    case NodeType::LITERAL_COMPOSITE:
+      Append(node.text);
+      break;
+    default:
+      Append(NodeTypeName(node.type));
+      Append(" ()");
+      break;
+  }
+}
+
+void ScadWriter::WriteNode(const Node& node, int indent_level, bool expand_module) {
+  if (!expand_module && !modules_.empty()) {
+    auto it = modules_.find(&node);
+    if (it != modules_.end()) {
+      AppendIndent(indent_level);
+      Append("shape_");
+      AppendInt(it->second);
+      Append("();\n");
+      return;
+    }
+  }
+  if (IsPrimitive(node.type)) {
+    AppendIndent(indent_level);
+    WritePrimitive(node);
+    Append('\n');
+    return;
+  }
+  if (node.type == NodeType::COMMENT) {
+    AppendIndent(indent_level);
+    Append("/* ");
+    Append(node.text);
+    Append(" */\n");
+    for (const Shape& s : node.children) {
+      if (!s.empty()) {
+        WriteNode(*s.node(), indent_level);
+      }
+    }
+    return;
+  }
+  AppendIndent(indent_level);
+  WriteCompositeName(node);
+  Append(" {\n");
+  for (const Shape& s : node.children) {
+    if (!s.empty()) {
+      WriteNode(*s.node(), indent_level + 1);
+    }
+  }
+  AppendIndent(indent_level);
+  Append("}\n");
+}
+
+void ScadWriter::WriteInline(const Node& node, int indent_level) {
+  modules_.clear();
+  WriteNode(node, indent_level);
+}
+
+void ScadWriter::WriteFile(const Shape& shape) {
+  modules_.clear();
+  if (shape.empty()) {
+    return;
+  }
+  std::vector<const Node*> shared = FindSharedNodes(shape);
+  for (size_t i = 0; i < shared.size(); ++i) {
+    modules_[shared[i]] = i;
+  }
+  // Dependencies come first since shared nodes are in children first order.
+  for (size_t i = 0; i < shared.size(); ++i) {
+    Append("module shape_");
+    AppendInt(i);
+    Append("() {\n");
+    WriteNode(*shared[i], 1, /*expand_module=*/true);
+    Append("}\n\n");
+  }
+  WriteNode(*shape.node(), 0);
+  modules_.clear();
+}
+
+long long WriteScadFile(const Shape& shape, const std::string& file_name) {
+  std::FILE* file = nullptr;
+  bool opened = false;
+#ifdef _WIN32
+  opened = fopen_s(&file, file_name.c_str(), "w") == 0;
+#else
+  file = std::fopen(file_name.c_str(), "w");
+  opened = file != nullptr;
+#endif
+
+  if (!opened || file == nullptr) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return -1;
+  }
+  long long bytes = -1;
+  {
+    ScadWriter writer(file);
+    writer.WriteFile(shape);
+    if (writer.Flush()) {
+      bytes = writer.bytes_written();
+    }
+  }
+  if (std::fclose(file) != 0 || bytes < 0) {
+    fprintf(stderr, "Could not write file %s\n", file_name.c_str());
+    return -1;
+  }
+  return bytes;
+}
+
+std::string ToScad(const Shape& shape) {
+  std::string out;
+  {
+    ScadWriter writer(&out);
+    writer.WriteFile(shape);
+  }
+  return out;
+}
+
+}  // namespace scad
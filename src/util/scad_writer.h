@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "scad.h"
+
+namespace scad {
+
+// Writes OpenSCAD source for shapes. Output is collected in a fixed size buffer which is only
+// flushed when it fills up, numbers are formatted with std::to_chars and indentation is copied from
+// a precomputed string, so writing does not allocate or go through stdio per token.
+//
+// A writer either flushes to a file or appends to a string.
+class ScadWriter {
+ public:
+  static constexpr size_t kBufferSize = 1 << 20;
+
+  // The file is not owned and is not closed by the writer.
+  explicit ScadWriter(std::FILE* file);
+  explicit ScadWriter(std::string* out);
+  ~ScadWriter();
+
+  ScadWriter(const ScadWriter&) = delete;
+  ScadWriter& operator=(const ScadWriter&) = delete;
+
+  // Writes a complete file for shape. Every subtree which is referenced more than once is written
+  // a single time as a module and each use becomes a call to that module, which keeps the file
+  // small and lets OpenSCAD reuse the geometry it has already evaluated.
+  void WriteFile(const Shape& shape);
+  // Writes node and everything below it with shared subtrees inlined.
+  void WriteInline(const Node& node, int indent_level);
+
+  // Returns false if writing to the file failed.
+  bool Flush();
+  // Bytes written so far, including those still in the buffer.
+  size_t bytes_written() const {
+    return flushed_ + size_;
+  }
+
+ private:
+  // Maps nodes which are written as OpenSCAD modules to their module number.
+  using ModuleIds = std::unordered_map<const Node*, size_t>;
+
+  void WriteNode(const Node& node, int indent_level, bool expand_module = false);
+  void WritePrimitive(const Node& node);
+  void WriteCompositeName(const Node& node);
+  void WriteResolution(const Node& node);
+  void WriteArgs(const std::vector<double>& args,
+                 size_t start,
+                 size_t count,
+                 int precision = 3);
+
+  void Append(std::string_view s);
+  void Append(char c);
+  void AppendIndent(int indent_level);
+  void AppendNumber(double value, int precision = 3);
+  void AppendInt(long long value);
+  void AppendBool(double value);
+  // Makes sure there are at least size bytes free in the buffer.
+  void Reserve(size_t size);
+
+  std::FILE* file_ = nullptr;
+  std::string* out_ = nullptr;
+  std::unique_ptr<char[]> buffer_;
+  size_t size_ = 0;
+  size_t flushed_ = 0;
+  bool failed_ = false;
+  ModuleIds modules_;
+};
+
+// Writes the OpenSCAD file for shape to file_name. Returns the number of bytes written or -1 if
+// the file could not be written.
+long long WriteScadFile(const Shape& shape, const std::string& file_name);
+// Returns the contents WriteScadFile would write.
+std::string ToScad(const Shape& shape);
+
+}  // namespace scad
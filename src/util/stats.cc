@@ -0,0 +1,228 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh.h"
+#include "scad.h"
+
+namespace scad {
+namespace {
+
+std::atomic<bool> stats_enabled(false);
+
+std::mutex& GetStagesMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::vector<StageStats>& GetStages() {
+  static std::vector<StageStats> stages;
+  return stages;
+}
+
+std::string FormatDouble(const char* format, double value) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), format, value);
+  return buffer;
+}
+
+// Stage names are chosen in code, but file names can hold anything.
+std::string JsonString(const std::string& s) {
+  std::string quoted = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buffer[8];
+      snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+      quoted += buffer;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+}  // namespace
+
+ShapeStats GetShapeStats(const Shape& shape) {
+  ShapeStats stats;
+  // Children are visited first, so their depths are known when their parents are reached.
+  std::unordered_map<const Node*, size_t> depths;
+  VisitNodes(shape, [&](const Node& node) {
+    size_t depth = 0;
+    for (const Shape& child : node.children) {
+      if (!child.empty()) {
+        depth = std::max(depth, depths[child.node()]);
+      }
+    }
+    depths[&node] = depth + 1;
+    stats.depth = std::max(stats.depth, depth + 1);
+    ++stats.nodes;
+    if (node.type == NodeType::HULL) {
+      ++stats.hulls;
+    }
+  });
+  return stats;
+}
+
+double EstimateRenderCost(const Shape& shape) {
+  double cost = 0;
+  // The number of facets of the geometry each node evaluates to, roughly.
+  std::unordered_map<const Node*, double> facets;
+  VisitNodes(shape, [&](const Node& node) {
+    double children = 0;
+    for (const Shape& child : node.children) {
+      if (!child.empty()) {
+        children += facets[child.node()];
+      }
+    }
+    double f = children;
+    int fragments = GetNodeFragments(node);
+    switch (node.type) {
+      case NodeType::CUBE:
+      case NodeType::SQUARE:
+        f = 6;
+        break;
+      case NodeType::SPHERE:
+        f = fragments * ((fragments + 1) / 2);
+        break;
+      case NodeType::CIRCLE:
+        f = fragments;
+        break;
+      case NodeType::CYLINDER:
+        f = fragments + 2;
+        break;
+      case NodeType::POLYGON:
+        f = node.args.size() / 2;
+        break;
+      case NodeType::POLYHEDRON:
+        f = node.faces.size();
+        break;
+      case NodeType::LINEAR_EXTRUDE:
+        // The sides and both caps.
+        f = 3 * children;
+        cost += f;
+        break;
+      case NodeType::UNION:
+      case NodeType::DIFFERENCE:
+      case NodeType::INTERSECTION:
+      case NodeType::HULL:
+      case NodeType::MINKOWSKI:
+      case NodeType::PROJECTION:
+        cost += children;
+        break;
+      default:
+        break;
+    }
+    facets[&node] = f;
+  });
+  return cost;
+}
+
+void EnableStats() {
+  stats_enabled = true;
+}
+
+bool StatsEnabled() {
+  return stats_enabled;
+}
+
+void RecordStage(const StageStats& stage) {
+  std::lock_guard<std::mutex> lock(GetStagesMutex());
+  GetStages().push_back(stage);
+}
+
+std::vector<StageStats> GetRecordedStages() {
+  std::lock_guard<std::mutex> lock(GetStagesMutex());
+  return GetStages();
+}
+
+StageTimer::StageTimer() : start_(std::chrono::steady_clock::now()) {
+}
+
+void StageTimer::Record(const std::string& name, const Shape& shape, long long bytes) {
+  auto now = std::chrono::steady_clock::now();
+  if (StatsEnabled()) {
+    StageStats stage;
+    stage.name = name;
+    stage.seconds = std::chrono::duration<double>(now - start_).count();
+    stage.has_shape = !shape.empty();
+    if (stage.has_shape) {
+      stage.shape = GetShapeStats(shape);
+    }
+    stage.bytes = bytes;
+    RecordStage(stage);
+  }
+  // Computing the shape stats is not part of the next stage.
+  start_ = std::chrono::steady_clock::now();
+}
+
+std::string FormatTable(const std::vector<std::vector<std::string>>& rows) {
+  std::vector<size_t> widths;
+  for (const auto& row : rows) {
+    widths.resize(std::max(widths.size(), row.size()));
+    for (size_t i = 0; i < row.size(); ++i) {
+      widths[i] = std::max(widths[i], row[i].size());
+    }
+  }
+  std::string table;
+  for (const auto& row : rows) {
+    for (size_t i = 0; i < row.size(); ++i) {
+      table += row[i];
+      if (i + 1 < row.size()) {
+        table += std::string(widths[i] - row[i].size() + 2, ' ');
+      }
+    }
+    table += "\n";
+  }
+  return table;
+}
+
+std::string FormatStatsTable(const std::vector<StageStats>& stages) {
+  std::vector<std::vector<std::string>> rows = {
+      {"stage", "seconds", "nodes", "hulls", "depth", "bytes"}};
+  for (const StageStats& stage : stages) {
+    std::vector<std::string> row = {stage.name, FormatDouble("%.3f", stage.seconds)};
+    if (stage.has_shape) {
+      row.push_back(std::to_string(stage.shape.nodes));
+      row.push_back(std::to_string(stage.shape.hulls));
+      row.push_back(std::to_string(stage.shape.depth));
+    } else {
+      row.insert(row.end(), {"-", "-", "-"});
+    }
+    row.push_back(stage.bytes >= 0 ? std::to_string(stage.bytes) : "-");
+    rows.push_back(row);
+  }
+  return FormatTable(rows);
+}
+
+std::string FormatStatsJson(const std::vector<StageStats>& stages) {
+  std::string json = "[";
+  for (size_t i = 0; i < stages.size(); ++i) {
+    const StageStats& stage = stages[i];
+    json += i == 0 ? "\n" : ",\n";
+    json += "  {\"stage\": " + JsonString(stage.name);
+    json += ", \"seconds\": " + FormatDouble("%.6f", stage.seconds);
+    if (stage.has_shape) {
+      json += ", \"nodes\": " + std::to_string(stage.shape.nodes);
+      json += ", \"hulls\": " + std::to_string(stage.shape.hulls);
+      json += ", \"depth\": " + std::to_string(stage.shape.depth);
+    }
+    if (stage.bytes >= 0) {
+      json += ", \"bytes\": " + std::to_string(stage.bytes);
+    }
+    json += "}";
+  }
+  return json + "\n]\n";
+}
+
+}  // namespace scad
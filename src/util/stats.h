@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "scad.h"
+
+namespace scad {
+
+// The size of a shape graph.
+struct ShapeStats {
+  // Distinct nodes, a node shared by several parents is counted once.
+  size_t nodes = 0;
+  size_t hulls = 0;
+  // The number of nodes on the longest path from the root to a primitive.
+  size_t depth = 0;
+};
+
+ShapeStats GetShapeStats(const Shape& shape);
+
+// A rough measure of how long OpenSCAD takes to render shape: the number of facets going into each
+// boolean operation, hull and extrusion, with shared subtrees counted once since OpenSCAD caches
+// them. Only meaningful for comparing shapes. Call it on the optimized shape, hulls which are left
+// in the graph are much more expensive than the polyhedra they are replaced with.
+double EstimateRenderCost(const Shape& shape);
+
+// How long a stage of generating the model took and what it produced.
+struct StageStats {
+  std::string name;
+  double seconds = 0;
+  // Unset if the stage did not build a shape.
+  bool has_shape = false;
+  ShapeStats shape;
+  // Bytes written to files, or -1 if the stage did not write any.
+  long long bytes = -1;
+};
+
+// Stats are only collected once enabled, so the timers cost next to nothing otherwise.
+void EnableStats();
+bool StatsEnabled();
+
+// Adds a stage to the report. Thread safe.
+void RecordStage(const StageStats& stage);
+// Every stage recorded so far, in the order they were recorded.
+std::vector<StageStats> GetRecordedStages();
+
+// Times the stages of generation. Each Record ends a stage which started when the timer was created
+// or when the previous stage ended, and starts the next one.
+class StageTimer {
+ public:
+  StageTimer();
+
+  // The shape stats are only computed while stats are enabled.
+  void Record(const std::string& name, const Shape& shape = Shape(), long long bytes = -1);
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Pads every column to its widest cell.
+std::string FormatTable(const std::vector<std::vector<std::string>>& rows);
+
+// One row per stage, as a table or as a JSON array of objects.
+std::string FormatStatsTable(const std::vector<StageStats>& stages);
+std::string FormatStatsJson(const std::vector<StageStats>& stages);
+
+}  // namespace scad
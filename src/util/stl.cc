@@ -0,0 +1,177 @@
+#include "stl.h"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "mesh.h"
+
+namespace scad {
+namespace {
+
+const size_t kHeaderSize = 80;
+// A normal, three vertices and the attribute byte count.
+const size_t kTriangleSize = 12 * sizeof(float) + sizeof(uint16_t);
+
+// STL is little endian, as is every platform this builds on.
+void AppendFloat(float value, std::vector<char>* out) {
+  char bytes[sizeof(float)];
+  std::memcpy(bytes, &value, sizeof(float));
+  out->insert(out->end(), bytes, bytes + sizeof(float));
+}
+
+float ReadFloat(const char* data) {
+  float value;
+  std::memcpy(&value, data, sizeof(float));
+  return value;
+}
+
+class VertexMap {
+ public:
+  explicit VertexMap(Mesh* mesh) : mesh_(mesh) {
+  }
+
+  int Add(const glm::dvec3& v) {
+    auto inserted = indices_.emplace(std::make_tuple(v.x, v.y, v.z), mesh_->vertices.size());
+    if (inserted.second) {
+      mesh_->vertices.push_back(v);
+    }
+    return inserted.first->second;
+  }
+
+ private:
+  Mesh* mesh_;
+  std::map<std::tuple<double, double, double>, int> indices_;
+};
+
+bool ReadBinary(const std::string& data, Mesh* mesh) {
+  uint32_t count;
+  std::memcpy(&count, data.data() + kHeaderSize, sizeof(count));
+  if (data.size() != kHeaderSize + sizeof(count) + count * kTriangleSize) {
+    return false;
+  }
+  Mesh result;
+  VertexMap vertices(&result);
+  const char* p = data.data() + kHeaderSize + sizeof(count);
+  for (uint32_t i = 0; i < count; ++i, p += kTriangleSize) {
+    std::array<int, 3> triangle;
+    for (int v = 0; v < 3; ++v) {
+      // Skip the normal, it is implied by the winding.
+      const char* vertex = p + (3 + v * 3) * sizeof(float);
+      triangle[v] = vertices.Add(glm::dvec3(ReadFloat(vertex),
+                                            ReadFloat(vertex + sizeof(float)),
+                                            ReadFloat(vertex + 2 * sizeof(float))));
+    }
+    result.triangles.push_back(triangle);
+  }
+  *mesh = std::move(result);
+  return true;
+}
+
+bool ReadAscii(const std::string& data, Mesh* mesh) {
+  std::istringstream in(data);
+  Mesh result;
+  VertexMap vertices(&result);
+  std::array<int, 3> triangle;
+  int corner = 0;
+  std::string token;
+  while (in >> token) {
+    if (token != "vertex") {
+      continue;
+    }
+    glm::dvec3 v;
+    if (!(in >> v.x >> v.y >> v.z)) {
+      return false;
+    }
+    triangle[corner++] = vertices.Add(v);
+    if (corner == 3) {
+      result.triangles.push_back(triangle);
+      corner = 0;
+    }
+  }
+  if (corner != 0) {
+    return false;
+  }
+  *mesh = std::move(result);
+  return true;
+}
+
+}  // namespace
+
+long long WriteStlFile(const Mesh& mesh, const std::string& file_name) {
+  std::vector<char> out;
+  out.reserve(kHeaderSize + sizeof(uint32_t) + mesh.triangles.size() * kTriangleSize);
+  out.resize(kHeaderSize, ' ');
+  const char kHeader[] = "binary stl written by dactyl";
+  std::memcpy(out.data(), kHeader, sizeof(kHeader) - 1);
+  uint32_t count = mesh.triangles.size();
+  char count_bytes[sizeof(count)];
+  std::memcpy(count_bytes, &count, sizeof(count));
+  out.insert(out.end(), count_bytes, count_bytes + sizeof(count));
+
+  for (const auto& t : mesh.triangles) {
+    const glm::dvec3& a = mesh.vertices[t[0]];
+    const glm::dvec3& b = mesh.vertices[t[1]];
+    const glm::dvec3& c = mesh.vertices[t[2]];
+    glm::dvec3 normal = glm::cross(b - a, c - a);
+    double length = glm::length(normal);
+    normal = length > 0 ? normal / length : glm::dvec3(0);
+    for (const glm::dvec3& v : {normal, a, b, c}) {
+      AppendFloat(v.x, &out);
+      AppendFloat(v.y, &out);
+      AppendFloat(v.z, &out);
+    }
+    out.push_back(0);
+    out.push_back(0);
+  }
+
+  std::FILE* file = nullptr;
+  bool opened = false;
+#ifdef _WIN32
+  opened = fopen_s(&file, file_name.c_str(), "wb") == 0;
+#else
+  file = std::fopen(file_name.c_str(), "wb");
+  opened = file != nullptr;
+#endif
+  if (!opened || file == nullptr) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return -1;
+  }
+  bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+  if (std::fclose(file) != 0 || !ok) {
+    fprintf(stderr, "Could not write file %s\n", file_name.c_str());
+    return -1;
+  }
+  return out.size();
+}
+
+bool ReadStlFile(const std::string& file_name, Mesh* mesh) {
+  std::ifstream in(file_name, std::ios::binary);
+  if (!in) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  std::string data = buffer.str();
+  // ASCII files start with "solid", but so do some binary ones. The size of a binary file is
+  // implied by its triangle count, which is a reliable way to tell them apart.
+  if (data.size() >= kHeaderSize + sizeof(uint32_t) && ReadBinary(data, mesh)) {
+    return true;
+  }
+  if (ReadAscii(data, mesh)) {
+    return true;
+  }
+  fprintf(stderr, "Could not parse STL file %s\n", file_name.c_str());
+  return false;
+}
+
+}  // namespace scad
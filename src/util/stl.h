@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+#include "mesh.h"
+
+namespace scad {
+
+// Writes mesh as a binary STL file. Returns the number of bytes written or -1 if the file could
+// not be written.
+long long WriteStlFile(const Mesh& mesh, const std::string& file_name);
+
+// Reads a binary or ASCII STL file. Vertices are shared between triangles where they are identical.
+bool ReadStlFile(const std::string& file_name, Mesh* mesh);
+
+}  // namespace scad
@@ -0,0 +1,109 @@
+#include "task_graph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+namespace scad {
+
+TaskGraph::TaskId TaskGraph::Add(const std::string& name,
+                                 std::function<bool()> fn,
+                                 const std::vector<TaskId>& dependencies) {
+  TaskId id = tasks_.size();
+  Task task;
+  task.name = name;
+  task.fn = std::move(fn);
+  task.dependency_count = dependencies.size();
+  for (TaskId dependency : dependencies) {
+    assert(dependency < id);
+    tasks_[dependency].dependents.push_back(id);
+  }
+  tasks_.push_back(std::move(task));
+  return id;
+}
+
+std::vector<TaskResult> TaskGraph::Run(int num_threads, const ProgressFn& progress) {
+  const size_t total = tasks_.size();
+  std::vector<TaskResult> results(total);
+  std::vector<size_t> waiting_for(total);
+  std::vector<bool> dependency_failed(total, false);
+  std::deque<TaskId> ready;
+  for (TaskId id = 0; id < total; ++id) {
+    results[id].name = tasks_[id].name;
+    waiting_for[id] = tasks_[id].dependency_count;
+    if (waiting_for[id] == 0) {
+      ready.push_back(id);
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  size_t finished = 0;
+  // Called with the lock held once a task has run or been skipped.
+  auto finish = [&](TaskId id) {
+    ++finished;
+    for (TaskId dependent : tasks_[id].dependents) {
+      if (!results[id].ok) {
+        dependency_failed[dependent] = true;
+      }
+      if (--waiting_for[dependent] == 0) {
+        ready.push_back(dependent);
+      }
+    }
+    if (progress) {
+      progress(results[id], finished, total);
+    }
+    changed.notify_all();
+  };
+
+  auto work = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      changed.wait(lock, [&]() { return !ready.empty() || finished == total; });
+      if (ready.empty()) {
+        return;
+      }
+      TaskId id = ready.front();
+      ready.pop_front();
+      if (!dependency_failed[id]) {
+        lock.unlock();
+        auto start = std::chrono::steady_clock::now();
+        bool ok = tasks_[id].fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        lock.lock();
+        results[id].ok = ok;
+        results[id].ran = true;
+        results[id].seconds = elapsed.count();
+      }
+      finish(id);
+    }
+  };
+
+  if (num_threads <= 0) {
+    num_threads = DefaultThreadCount();
+  }
+  size_t worker_count = std::min<size_t>(num_threads, total);
+  // The calling thread is one of the workers.
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < worker_count; ++i) {
+    threads.emplace_back(work);
+  }
+  if (total > 0) {
+    work();
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return results;
+}
+
+}  // namespace scad
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace scad {
+
+struct TaskResult {
+  std::string name;
+  bool ok = false;
+  // False if the task was skipped because one of its dependencies failed.
+  bool ran = false;
+  double seconds = 0;
+};
+
+// Tasks which run on a pool of worker threads as soon as the tasks they depend on have finished.
+// Dependencies have to be added before the tasks which depend on them, so there can be no cycles.
+class TaskGraph {
+ public:
+  using TaskId = size_t;
+  // Called after each task finishes, one at a time, with the number of tasks finished so far.
+  using ProgressFn = std::function<void(const TaskResult& result, size_t finished, size_t total)>;
+
+  // fn returns false if the task failed, in which case the tasks depending on it are skipped.
+  TaskId Add(const std::string& name,
+             std::function<bool()> fn,
+             const std::vector<TaskId>& dependencies = {});
+
+  size_t size() const {
+    return tasks_.size();
+  }
+
+  // Runs every task on up to num_threads threads (<= 0 uses DefaultThreadCount()) and returns once
+  // all of them have finished or been skipped. Results are in the order the tasks were added.
+  std::vector<TaskResult> Run(int num_threads = 0, const ProgressFn& progress = nullptr);
+
+ private:
+  struct Task {
+    std::string name;
+    std::function<bool()> fn;
+    std::vector<TaskId> dependents;
+    size_t dependency_count = 0;
+  };
+
+  std::vector<Task> tasks_;
+};
+
+}  // namespace scad
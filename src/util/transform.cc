@@ -1,22 +1,198 @@
 #include "transform.h"
 
+#include <atomic>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/simd/platform.h>
 #include <vector>
 
 #include "scad.h"
 
 namespace scad {
+namespace {
 
-glm::vec3 Transform::Apply(const glm::vec3& p) const {
-  glm::mat4 transform(1.0f);
-  transform = glm::translate(transform, translation());
-  transform = glm::rotate(transform, glm::radians((float)ry), glm::vec3(0, 1, 0));
-  transform = glm::rotate(transform, glm::radians((float)rx), glm::vec3(1, 0, 0));
-  transform = glm::rotate(transform, glm::radians((float)rz), glm::vec3(0, 0, 1));
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "ApplyAll expects packed points");
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+
+// Points are transformed four at a time. They are loaded into one register per coordinate, each
+// output coordinate is computed in double precision, in the same order of operations as
+// glm::dmat4 * glm::dvec4 so the results match Apply exactly, and then they are interleaved again.
+const size_t kBatchSize = 4;
+
+void LoadPoints(const glm::vec3* points, __m128* x, __m128* y, __m128* z) {
+  const float* f = &points[0].x;
+  __m128 a = _mm_loadu_ps(f);      // x0 y0 z0 x1
+  __m128 b = _mm_loadu_ps(f + 4);  // y1 z1 x2 y2
+  __m128 c = _mm_loadu_ps(f + 8);  // z2 x3 y3 z3
+  *x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+  *y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+                      _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),
+                      _MM_SHUFFLE(2, 0, 2, 0));
+  *z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+                      _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),
+                      _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+void StorePoints(__m128 x, __m128 y, __m128 z, glm::vec3* points) {
+  float* f = &points[0].x;
+  _mm_storeu_ps(f,
+                _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)),
+                               _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)),
+                               _MM_SHUFFLE(2, 0, 2, 0)));
+  _mm_storeu_ps(f + 4,
+                _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)),
+                               _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)),
+                               _MM_SHUFFLE(2, 0, 2, 0)));
+  _mm_storeu_ps(f + 8,
+                _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)),
+                               _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)),
+                               _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
 
-  glm::vec4 transformed = transform * glm::vec4(p.x, p.y, p.z, 1);
-  return glm::vec3(transformed.x, transformed.y, transformed.z);
+// One row of the matrix, broadcast to every lane.
+struct MatrixRow {
+  __m256d m0, m1, m2, m3;
+};
+
+MatrixRow GetRow(const glm::dmat4& m, int row) {
+  return {_mm256_set1_pd(m[0][row]),
+          _mm256_set1_pd(m[1][row]),
+          _mm256_set1_pd(m[2][row]),
+          _mm256_set1_pd(m[3][row])};
+}
+
+__m128 ApplyRow(const MatrixRow& r, __m128 x, __m128 y, __m128 z) {
+  __m256d xy = _mm256_add_pd(_mm256_mul_pd(r.m0, _mm256_cvtps_pd(x)),
+                             _mm256_mul_pd(r.m1, _mm256_cvtps_pd(y)));
+  __m256d zw = _mm256_add_pd(_mm256_mul_pd(r.m2, _mm256_cvtps_pd(z)), r.m3);
+  return _mm256_cvtpd_ps(_mm256_add_pd(xy, zw));
+}
+
+#else
+
+// One row of the matrix, broadcast to every lane.
+struct MatrixRow {
+  __m128d m0, m1, m2, m3;
+};
+
+MatrixRow GetRow(const glm::dmat4& m, int row) {
+  return {_mm_set1_pd(m[0][row]), _mm_set1_pd(m[1][row]), _mm_set1_pd(m[2][row]),
+          _mm_set1_pd(m[3][row])};
+}
+
+// SSE2 only holds two doubles per register, so each half is done separately.
+__m128d ApplyRowHalf(const MatrixRow& r, __m128d x, __m128d y, __m128d z) {
+  __m128d xy = _mm_add_pd(_mm_mul_pd(r.m0, x), _mm_mul_pd(r.m1, y));
+  __m128d zw = _mm_add_pd(_mm_mul_pd(r.m2, z), r.m3);
+  return _mm_add_pd(xy, zw);
+}
+
+__m128 ApplyRow(const MatrixRow& r, __m128 x, __m128 y, __m128 z) {
+  __m128 low = _mm_cvtpd_ps(ApplyRowHalf(r, _mm_cvtps_pd(x), _mm_cvtps_pd(y), _mm_cvtps_pd(z)));
+  __m128 high = _mm_cvtpd_ps(ApplyRowHalf(r,
+                                          _mm_cvtps_pd(_mm_movehl_ps(x, x)),
+                                          _mm_cvtps_pd(_mm_movehl_ps(y, y)),
+                                          _mm_cvtps_pd(_mm_movehl_ps(z, z))));
+  return _mm_movelh_ps(low, high);
+}
+
+#endif  // GLM_ARCH & GLM_ARCH_AVX_BIT
+
+// Transforms count points, which must be a multiple of kBatchSize.
+void ApplyBatches(const glm::dmat4& m, const glm::vec3* in, glm::vec3* out, size_t count) {
+  const MatrixRow rows[3] = {GetRow(m, 0), GetRow(m, 1), GetRow(m, 2)};
+  for (size_t i = 0; i < count; i += kBatchSize) {
+    __m128 x, y, z;
+    LoadPoints(in + i, &x, &y, &z);
+    StorePoints(ApplyRow(rows[0], x, y, z),
+                ApplyRow(rows[1], x, y, z),
+                ApplyRow(rows[2], x, y, z),
+                out + i);
+  }
+}
+
+#else
+
+// Without SIMD everything goes through the scalar loop in ApplyAll.
+const size_t kBatchSize = 1;
+
+void ApplyBatches(const glm::dmat4&, const glm::vec3*, glm::vec3*, size_t) {
+}
+
+#endif  // GLM_ARCH & GLM_ARCH_SSE2_BIT
+
+}  // namespace
+
+glm::dmat4 GetNodeMatrix(const Node& node) {
+  const std::vector<double>& args = node.args;
+  glm::dmat4 m(1.0);
+  switch (node.type) {
+    case NodeType::TRANSLATE:
+      return glm::translate(m, glm::dvec3(args[0], args[1], args[2]));
+    case NodeType::ROTATE:
+      // OpenSCAD rotates about x, then y, then z.
+      m = glm::rotate(m, glm::radians(args[2]), glm::dvec3(0, 0, 1));
+      m = glm::rotate(m, glm::radians(args[1]), glm::dvec3(0, 1, 0));
+      return glm::rotate(m, glm::radians(args[0]), glm::dvec3(1, 0, 0));
+    case NodeType::ROTATE_AXIS:
+      return glm::rotate(m, glm::radians(args[0]), glm::dvec3(args[1], args[2], args[3]));
+    case NodeType::MIRROR: {
+      glm::dvec3 n(args[0], args[1], args[2]);
+      if (glm::length(n) == 0) {
+        return m;
+      }
+      n = glm::normalize(n);
+      for (int col = 0; col < 3; ++col) {
+        for (int row = 0; row < 3; ++row) {
+          m[col][row] -= 2 * n[row] * n[col];
+        }
+      }
+      return m;
+    }
+    case NodeType::SCALE:
+      return glm::scale(m, glm::dvec3(args[0], args[1], args[2]));
+    case NodeType::MULTMATRIX:
+      for (int row = 0; row < 4; ++row) {
+        for (int col = 0; col < 4; ++col) {
+          m[col][row] = args[row * 4 + col];
+        }
+      }
+      return m;
+    default:
+      return m;
+  }
+}
+
+Shape MultMatrix(const glm::dmat4& matrix, const Shape& shape) {
+  std::vector<double> rows(16);
+  for (int row = 0; row < 4; ++row) {
+    for (int col = 0; col < 4; ++col) {
+      rows[row * 4 + col] = matrix[col][row];
+    }
+  }
+  return shape.MultMatrix(rows);
+}
+
+glm::dmat4 Transform::matrix() const {
+  glm::dmat4 transform(1.0);
+  transform = glm::translate(transform, glm::dvec3(x, y, z));
+  if (ry != 0) {
+    transform = glm::rotate(transform, glm::radians(ry), glm::dvec3(0, 1, 0));
+  }
+  if (rx != 0) {
+    transform = glm::rotate(transform, glm::radians(rx), glm::dvec3(1, 0, 0));
+  }
+  if (rz != 0) {
+    transform = glm::rotate(transform, glm::radians(rz), glm::dvec3(0, 0, 1));
+  }
+  return transform;
+}
+
+glm::vec3 Transform::Apply(const glm::vec3& p) const {
+  return glm::vec3(matrix() * glm::dvec4(p, 1));
 }
 
 Shape TransformList::Apply(const Shape& in) const {
@@ -27,12 +203,67 @@ Shape TransformList::Apply(const Shape& in) const {
   return shape;
 }
 
-glm::vec3 TransformList::Apply(const glm::vec3& in) const {
-  glm::vec3 point = in;
-  for (auto& transform : transforms_) {
-    point = transform.Apply(point);
+uint64_t TransformList::NextRevision() {
+  static std::atomic<uint64_t> next_revision(1);
+  return next_revision.fetch_add(1, std::memory_order_relaxed);
+}
+
+TransformList::TransformList(const TransformList& other)
+    : transforms_(other.transforms_), revision_(other.revision_) {
+  if (other.matrix_state_.load(std::memory_order_acquire) == VALID) {
+    matrix_ = other.matrix_;
+    matrix_state_.store(VALID, std::memory_order_relaxed);
   }
-  return point;
+}
+
+TransformList& TransformList::operator=(const TransformList& other) {
+  if (this != &other) {
+    transforms_ = other.transforms_;
+    revision_ = other.revision_;
+    bool valid = other.matrix_state_.load(std::memory_order_acquire) == VALID;
+    if (valid) {
+      matrix_ = other.matrix_;
+    }
+    matrix_state_.store(valid ? VALID : STALE, std::memory_order_relaxed);
+  }
+  return *this;
+}
+
+glm::dmat4 TransformList::matrix() const {
+  if (matrix_state_.load(std::memory_order_acquire) == VALID) {
+    return matrix_;
+  }
+  // The first transform is applied first, so it ends up rightmost.
+  glm::dmat4 m(1.0);
+  for (const Transform& transform : transforms_) {
+    m = transform.matrix() * m;
+  }
+  // A reader which loses the race to fill the cache just uses its own copy.
+  int stale = STALE;
+  if (matrix_state_.compare_exchange_strong(stale, COMPOSING, std::memory_order_acquire)) {
+    matrix_ = m;
+    matrix_state_.store(VALID, std::memory_order_release);
+  }
+  return m;
+}
+
+glm::vec3 TransformList::Apply(const glm::vec3& p) const {
+  return glm::vec3(matrix() * glm::dvec4(p, 1));
+}
+
+void TransformList::ApplyAll(const glm::vec3* in, glm::vec3* out, size_t count) const {
+  glm::dmat4 m = matrix();
+  size_t batched = kBatchSize > 1 ? count - count % kBatchSize : 0;
+  ApplyBatches(m, in, out, batched);
+  for (size_t i = batched; i < count; ++i) {
+    out[i] = glm::vec3(m * glm::dvec4(in[i], 1));
+  }
+}
+
+std::vector<glm::vec3> TransformList::ApplyAll(const std::vector<glm::vec3>& points) const {
+  std::vector<glm::vec3> result(points.size());
+  ApplyAll(points.data(), result.data(), points.size());
+  return result;
 }
 
 }  // namespace scad
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <vector>
 
@@ -9,6 +11,10 @@ namespace scad {
 
 const glm::vec3 kOrigin(0, 0, 0);
 
+// The matrix of an affine transform node (see IsAffineTransform).
+glm::dmat4 GetNodeMatrix(const Node& node);
+Shape MultMatrix(const glm::dmat4& matrix, const Shape& shape);
+
 // A rotation and translation. The rotations are applied first in z,x,y order and then the
 // translation is added.
 struct Transform {
@@ -90,22 +96,52 @@ struct Transform {
   }
 
   glm::vec3 Apply(const glm::vec3& p) const;
+  // The matrix which applies this transform.
+  glm::dmat4 matrix() const;
 };
 
 // A list of transforms to apply to a shape or a point. The transforms are applied in order. If you
 // are looking at a shape which has been placed by a transform list and you want to rotate it in
 // place, the transform you add needs to be applied first and you must use a "front" method.
+//
+// The composed matrix of the list is cached the first time it is needed, so applying the same list
+// to many points costs one matrix multiply each. Filling the cache is safe while other threads read
+// the same list, so a list which is not being changed can be shared between threads. Every method
+// which changes the list or hands out a mutable Transform clears the cache, so those references
+// must not be kept around and written to after the list has been applied again.
 class TransformList {
  public:
+  TransformList() = default;
+  TransformList(const TransformList& other);
+  TransformList& operator=(const TransformList& other);
+
   Shape Apply(const Shape& shape) const;
+  // Points are transformed by the composed matrix in double precision and only rounded to float at
+  // the end, so results can differ in the last float bits from applying each transform in turn.
   glm::vec3 Apply(const glm::vec3& p) const;
+  // The same as calling Apply for each of the count points in in, but several points are
+  // transformed at once with SIMD instructions where they are available. out may be the same array
+  // as in.
+  void ApplyAll(const glm::vec3* in, glm::vec3* out, size_t count) const;
+  std::vector<glm::vec3> ApplyAll(const std::vector<glm::vec3>& points) const;
+
+  // All of the transforms composed into one matrix.
+  glm::dmat4 matrix() const;
+
+  // Changes whenever the list is changed, under the same rules as the matrix cache. Two lists with
+  // the same revision hold the same transforms, since one was copied from the other.
+  uint64_t revision() const {
+    return revision_;
+  }
 
   Transform& AddTransform(Transform t = {}) {
+    Invalidate();
     transforms_.push_back(t);
     return transforms_.back();
   }
 
   Transform& AddTransformFront(Transform t = {}) {
+    Invalidate();
     transforms_.insert(transforms_.begin(), t);
     return transforms_.front();
   }
@@ -118,6 +154,7 @@ class TransformList {
     if (empty()) {
       return AddTransform();
     }
+    Invalidate();
     return transforms_.front();
   }
 
@@ -171,17 +208,33 @@ class TransformList {
   }
 
   TransformList& Append(const TransformList& other) {
+    Invalidate();
     transforms_.insert(transforms_.end(), other.transforms_.begin(), other.transforms_.end());
     return *this;
   }
 
   TransformList& AppendFront(const TransformList& other) {
+    Invalidate();
     transforms_.insert(transforms_.begin(), other.transforms_.begin(), other.transforms_.end());
     return *this;
   }
 
  private:
+  static uint64_t NextRevision();
+
+  // The states of the matrix cache. Only the reader which moves it from STALE to COMPOSING writes
+  // matrix_, and other readers only read it once they see VALID, so they never race.
+  enum MatrixState { STALE, COMPOSING, VALID };
+
+  void Invalidate() {
+    matrix_state_.store(STALE, std::memory_order_relaxed);
+    revision_ = NextRevision();
+  }
+
   std::vector<Transform> transforms_;
+  mutable glm::dmat4 matrix_;
+  mutable std::atomic<int> matrix_state_{STALE};
+  uint64_t revision_ = NextRevision();
 };
 
 }  // namespace scad